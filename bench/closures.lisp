@@ -0,0 +1,8 @@
+(define make-counter (lambda () (begin (define n 0) (lambda () (begin (set! n (+ n 1)) n)))))
+(define make-adder (lambda (a) (lambda (x) (+ x a))))
+(define compose (lambda (f g) (lambda (x) (f (g x)))))
+(define twice (lambda (f) (compose f f)))
+(define count (lambda (c k) (if (= k 0) (c) (begin (c) (count c (- k 1))))))
+(define chain (lambda (f k x) (if (= k 0) x (chain f (- k 1) (f x)))))
+(count (make-counter) 20000)
+(chain (twice (twice (make-adder 1))) 5000 0)
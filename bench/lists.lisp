@@ -0,0 +1,4 @@
+(define build (lambda (n acc) (if (= n 0) acc (build (- n 1) (cons n acc)))))
+(define grow (lambda (n acc) (if (= n 0) acc (grow (- n 1) (append acc (list n))))))
+(define repeat (lambda (k) (if (= k 0) 0 (begin (build 200 (list)) (grow 200 (list)) (repeat (- k 1))))))
+(repeat 20)
@@ -0,0 +1,6 @@
+(define build (lambda (n acc) (if (= n 0) acc (build (- n 1) (cons n acc)))))
+(define total (lambda (l acc) (if (null? l) acc (total (cdr l) (+ acc (car l))))))
+(define rows (pmap (lambda (x) (build 300 (list))) (build 2000 (list))))
+(define sums (pmap (lambda (row) (total row 0)) rows))
+(pfor-each (lambda (row) (build 300 row)) rows)
+(preduce (lambda (a b) (+ a (total (build 300 (list)) 0) b)) 0 sums)
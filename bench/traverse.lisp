@@ -0,0 +1,7 @@
+(define iota (lambda (n acc) (if (= n 0) acc (iota (- n 1) (append (list n) acc)))))
+(define items (iota 200 (list)))
+(define sum (lambda (l acc) (if (null? l) acc (if (list? l) (sum (cdr l) (+ acc (car l))) acc))))
+(define tree (lambda (d) (if (= d 0) (list d) (list (tree (- d 1)) (tree (- d 1))))))
+(define leaves (lambda (t) (if (list? t) (if (null? t) 0 (+ (leaves (car t)) (leaves (cdr t)))) 1)))
+(define walk (lambda (k) (if (= k 0) 0 (begin (sum items 0) (leaves (tree 9)) (walk (- k 1))))))
+(walk 10)
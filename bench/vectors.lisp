@@ -0,0 +1,7 @@
+; nearly all the time is in vector-sum, a primitive: cisp --sample should
+; count it for heavy, the lambda calling it, not for light or the top level
+(define v (make-f64vector 1000000 1.5))
+(define heavy (lambda () (+ (vector-sum v) (vector-sum v) (vector-sum v) (vector-sum v) (vector-sum v))))
+(define light (lambda (k) (if (= k 0) 0 (light (- k 1)))))
+(define repeat (lambda (k) (if (= k 0) 0 (begin (heavy) (light 20) (repeat (- k 1))))))
+(repeat 200)
@@ -1,14 +1,49 @@
 // cisp.cpp
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <list>
+#include <map>
+#include <new>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <list>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
 
 // return given number as a string
-std::string stringify(long n) {
+std::string stringify(int64_t n) {
     std::ostringstream outputString;
     outputString << n;
     return outputString.str();
@@ -20,6 +55,37 @@ bool isDigit(char c) {
 }
 
 
+////////////////////// allocation accounting
+
+// every operator new in the program goes through here so that reports and
+// benchmarks can tell how much heap traffic an evaluation causes; counted
+// per thread, and what the worker pool counts is added to the calling
+// thread's when a parallel primitive is done (see workerPool)
+thread_local size_t allocationCount = 0;
+thread_local size_t allocatedBytes = 0;
+
+void* operator new(size_t size)
+{
+    ++allocationCount;
+    allocatedBytes += size;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// Kept out of line: once GCC inlines a delete it sees free() called on
+// what operator new returned and warns (-Wmismatched-new-delete), not
+// knowing that this operator new is malloc underneath.
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE __declspec(noinline)
+#endif
+
+NOINLINE void operator delete(void* p) noexcept { free(p); }
+NOINLINE void operator delete(void* p, size_t) noexcept { free(p); }
+
+
 ////////////////////// cell/token type
 
 enum cellType {
@@ -27,584 +93,4991 @@ enum cellType {
     Number,
     List,
     Proc,
-    Lambda
+    Lambda,
+    Bignum, // an integer too large for a Number, see "numbers" below
+    Rational, // an exact fraction, see "numbers" below
+    Real, // a double, stored in the cell
+    F64Vector, // a fixed-size array of doubles, see "numeric vectors" below
+    HashTable, // see "hash tables" below
+    Memo // a procedure wrapped with a result cache, see "memoization" below
 };
 
 struct environment; // forward declaration; cell and environment reference each other
+struct lambdaNode; // the analyzed code of a lambda, see "analysis" below
+struct prototype; // the compiled code of a lambda, see "virtual machine" below
+struct symbol; // an interned symbol, see below
+struct pairObject; // a cons cell, see below
 
-// a variant that can hold any kind of lisp value
+// the part of a value that doesn't fit in a cell (a pair of a list, a
+// lambda, a frame of local variables); shared between copies of the cell and
+// owned by the garbage collector, which frees it once nothing reaches it
+struct heapObject {
+    heapObject* next; // every live object is on the collector's list
+    // as counted towards the heap size; sharing a 64-bit word with the mark
+    // bit keeps the header at three words without capping the size at 4 GiB
+    // (size_t can't be the type: bit-fields can't be wider than their type)
+    uint64_t bytes : 63;
+    uint64_t marked : 1;
+    heapObject() : next(0), bytes(0), marked(false) {}
+    virtual ~heapObject() {}
+    // mark the objects this one refers to (see markCell/markObject)
+    virtual void trace() {}
+};
+
+// a variant that can hold any kind of lisp value in two words: the type tag
+// and either an immediate (number, procedure) or a pointer to a heapObject
 struct cell {
     // type definitions for readable types below 
-    typedef cell(*procType)(const std::vector<cell>&);
+    typedef cell(*procType)(struct cellSpan);
     typedef std::vector<cell>::const_iterator iterator;
-    typedef std::map<std::string, cell> map;
 
     // actual fields
     cellType type;
-    std::string value;
-    std::vector<cell> list;
-    procType proc;
-    struct environment* environment;
+    union {
+        int64_t number; // value of a Number, parsed once by the reader
+        double real; // value of a Real
+        symbol* sym; // Symbol
+        procType proc;
+        heapObject* object; // payload of the other types: for a List a pair, or 0 for ()
+    };
 
     // initializers
-    cell(cellType type = Symbol) : type(type), environment(0) {}
-    cell(cellType type, const std::string& val) : type(type), value(val), environment(0) {}
-    cell(procType proc) : type(Proc), proc(proc), environment(0) {}
+    cell(cellType type = Symbol) : type(type), number(0) {}
+    cell(cellType type, std::string_view name);
+    cell(cellType type, int64_t n) : type(type), number(n) {}
+    cell(cellType type, struct cellSpan items); // a proper list of the items
+    cell(cellType type, const cell& car, const cell& cdr); // (car . cdr)
+    cell(cellType type, const std::shared_ptr<lambdaNode>& code, struct environment* env);
+    cell(cellType type, const std::shared_ptr<prototype>& compiled, struct environment* env);
+    cell(procType proc) : type(Proc), number(0) { this->proc = proc; }
+
+    // accessors for the heap payload
+    const std::string& name() const; // Symbol
+    pairObject* pair() const { return type == List ? reinterpret_cast<pairObject*>(object) : 0; } // List; 0 for ()
+    std::vector<cell> items() const; // the elements of a List, copied out; empty otherwise
+    bool isNull() const { return type == List && !object; }
+    struct lambdaObject* lambda() const { return reinterpret_cast<struct lambdaObject*>(object); } // Lambda
+    heapObject* heap() const { return (type == List || type == Lambda || type == Bignum || type == Rational || type == F64Vector || type == HashTable || type == Memo) ? object : 0; }
 };
 
 typedef std::vector<cell> cells;
 typedef cells::const_iterator cellIterator;
 
-const cell falseSymbol(Symbol, "False");
-const cell trueSymbol(Symbol, "True"); // anything that isn't falseSymbol is true
-const cell NIL(Symbol, "NIL");
-const cell spaceSymbol(Symbol, "\\s");
-const cell newlineSymbol(Symbol, "\\n");
-const cell whatTheFuck(Symbol, "");
+// the arguments of a primitive: consecutive cells on the value stack, in a
+// vector or anywhere else, without copying them
+struct cellSpan {
+    const cell* first;
+    size_t count;
+    cellSpan(const cell* first, size_t count) : first(first), count(count) {}
+    cellSpan(const cells& c) : first(c.data()), count(c.size()) {}
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const cell& operator[](size_t i) const { return first[i]; }
+    const cell* begin() const { return first; }
+    const cell* end() const { return first + count; }
+};
 
-////////////////////// environment
+// an interned symbol: there is exactly one of these per distinct name, so
+// symbols compare (and hash) by address; symbols live for the whole run.
+// The global environment is kept in the symbols themselves: `value` is the
+// symbol's global binding, and a default cell in it means "unbound".
+struct symbol {
+    std::string name;
+    cell value;
+    explicit symbol(const std::string& name) : name(name) {}
+};
+
+// keyed by views of the symbols' own names, so looking a name up never
+// has to copy it
+typedef std::unordered_map<std::string_view, symbol*> symbolTable;
+
+// every symbol that has been interned; function-local so it exists before
+// the global cells below use it
+symbolTable& symbols()
+{
+    static symbolTable table;
+    return table;
+}
+
+// return the unique symbol with the given name, creating it if needed
+symbol* intern(std::string_view name)
+{
+    static std::mutex lock; // parallel evaluation may read symbols too
+    std::lock_guard<std::mutex> hold(lock);
+    symbolTable& table = symbols();
+    symbolTable::iterator found = table.find(name);
+    if (found != table.end())
+        return found->second;
+    symbol* entry = new symbol(std::string(name));
+    table.emplace(entry->name, entry);
+    return entry;
+}
+
+
+////////////////////// garbage collection
 
-// a dictionary that (a) associates symbols with cells, and
-// (b) can chain to an "outer" dictionary
-struct environment {
-    environment(environment* outer = 0) : outer_(outer) {}
+// A tracing mark-sweep collector. Every heapObject is on one list; a
+// collection marks everything reachable from the roots and deletes the rest.
+// The roots are the symbols' global values, cells registered as rooted
+// (constants in analyzed code) and the root stacks that the evaluator pushes
+// its frames and in-flight values onto.
+//
+// Allocation never collects by itself: it only counts bytes, and the
+// evaluator calls gcPoll() at safe points (lambda entry, between top-level
+// forms) where every live value is known to be on a root.
+//
+// While a parallel primitive runs, collection is inhibited: worker threads
+// put what they allocate on lists of their own (see localHeap), which are
+// handed over to the collector once the workers are done.
 
-    environment(const cells& parms, const cells& args, environment* outer)
-        : outer_(outer)
+struct collector {
+    heapObject* objects; // every object allocated and not yet freed
+    size_t objectCount;
+    size_t heapBytes; // total size of the objects on the list
+    size_t allocatedSinceCollection;
+    size_t threshold; // collect once this many bytes were allocated
+    std::vector<heapObject*> gray; // marked objects whose references aren't yet traced
+    bool inhibited; // worker threads are evaluating, so don't collect
+
+    // statistics for (gc-stats)
+    size_t collections;
+    size_t freedBytes;
+    double lastPause, maxPause, totalPause; // in microseconds
+
+    collector()
+        : objects(0), objectCount(0), heapBytes(0), allocatedSinceCollection(0),
+          threshold(4 << 20), inhibited(false), collections(0), freedBytes(0),
+          lastPause(0), maxPause(0), totalPause(0) {}
+};
+
+collector heap;
+
+// the root stacks of one thread, see the *Root guards below; collections only
+// happen on the main thread while no other thread is evaluating
+struct rootStacks {
+    std::vector<const cell*> cellRoots;
+    std::vector<const cells*> vectorRoots;
+    std::vector<struct environment* const*> frameRoots;
+};
+
+thread_local rootStacks roots;
+
+// The value stack, where both engines evaluate the arguments of a call in
+// place: a primitive gets a span of it rather than a vector of its own.
+// Everything below `top` is live.
+struct valueStack {
+    static constexpr size_t size = 1 << 20;
+    cell* base;
+    cell* top; // first free slot
+    valueStack() : base(static_cast<cell*>(::operator new(size * sizeof(cell)))), top(base) {}
+    ~valueStack() { ::operator delete(base); }
+    bool has(size_t n) const { return top + n < base + size; }
+};
+
+thread_local valueStack values;
+
+// the objects a worker thread allocated, not yet on the collector's list
+struct localHeap {
+    heapObject* objects;
+    heapObject* last;
+    size_t objectCount;
+    size_t heapBytes;
+    localHeap() : objects(0), last(0), objectCount(0), heapBytes(0) {}
+};
+
+thread_local localHeap* nursery = 0; // set on worker threads only
+
+// hand a newly allocated object over to the collector
+template <typename T>
+T* track(T* object, size_t bytes = sizeof(T))
+{
+    object->bytes = bytes;
+    if (nursery) {
+        object->next = nursery->objects;
+        if (!nursery->objects)
+            nursery->last = object;
+        nursery->objects = object;
+        ++nursery->objectCount;
+        nursery->heapBytes += bytes;
+        return object;
+    }
+    object->next = heap.objects;
+    heap.objects = object;
+    ++heap.objectCount;
+    heap.heapBytes += bytes;
+    heap.allocatedSinceCollection += bytes;
+    return object;
+}
+
+// count an object that grew or shrank in place at its new size; on worker
+// threads it keeps counting as what it was allocated as
+void retrack(heapObject* object, size_t bytes)
+{
+    if (nursery)
+        return;
+    size_t old = size_t(object->bytes);
+    heap.heapBytes = heap.heapBytes - old + bytes;
+    if (bytes > old)
+        heap.allocatedSinceCollection += bytes - old;
+    object->bytes = bytes;
+}
+
+void markObject(heapObject* object)
+{
+    if (object && !object->marked) {
+        object->marked = true;
+        heap.gray.push_back(object);
+    }
+}
+
+void markCell(const cell& c)
+{
+    markObject(c.heap());
+}
+
+// a cell outside the heap that must stay alive as long as it exists itself,
+// e.g. a quoted constant in analyzed code
+struct rootedCell {
+    cell value;
+    rootedCell* prev;
+    rootedCell* next;
+
+    static rootedCell*& first()
 	{
-	    cellIterator a = args.begin();
-	    for (cellIterator p = parms.begin(); p != parms.end(); ++p)
-		env_[p->value] = *a++;
+	    static rootedCell* list = 0;
+	    return list;
 	}
 
-    // map a variable name onto a cell
-    typedef std::map<std::string, cell> map;
+    // code may be analyzed, and freed, on any thread
+    static std::mutex& lock()
+	{
+	    static std::mutex m;
+	    return m;
+	}
 
-    // return a reference to the innermost environment where 'var' appears
-    map& find(const std::string& var)
+    explicit rootedCell(const cell& value) : value(value), prev(0)
 	{
-	    if (env_.find(var) != env_.end())
-		return env_; // the symbol exists in this environment
-	    if (outer_)
-		return outer_->find(var); // attempt to find the symbol in some "outer" env
-	    std::cout << "unbound symbol '" << var << "'\n";
-	    return env_;
+	    std::lock_guard<std::mutex> hold(lock());
+	    next = first();
+	    if (next)
+		next->prev = this;
+	    first() = this;
 	}
 
-    // return a reference to the cell associated with the given symbol 'var'
-    cell& operator[] (const std::string& var)
+    ~rootedCell()
 	{
-	    return env_[var];
+	    std::lock_guard<std::mutex> hold(lock());
+	    if (prev)
+		prev->next = next;
+	    else
+		first() = next;
+	    if (next)
+		next->prev = prev;
 	}
 
     private:
-    map env_; // inner symbol->cell mapping
-    environment* outer_; // next adjacent outer env, or 0 if there are no further environments
+    rootedCell(const rootedCell&);
+    rootedCell& operator=(const rootedCell&);
 };
 
+// Guards that keep a C++ local alive across a call that may collect: the
+// local is pushed on a root stack for the lifetime of the guard.
+struct cellRoot {
+    explicit cellRoot(const cell& c) { roots.cellRoots.push_back(&c); }
+    ~cellRoot() { roots.cellRoots.pop_back(); }
+};
 
-////////////////////// built-in primitive procedures
+struct cellsRoot {
+    explicit cellsRoot(const cells& c) { roots.vectorRoots.push_back(&c); }
+    ~cellsRoot() { roots.vectorRoots.pop_back(); }
+};
 
-// Type predicates.
-cell symbolP(const cells& c) {
-    return c[0].type == Symbol ? trueSymbol : falseSymbol;
-}
+struct frameRoot {
+    explicit frameRoot(struct environment* const& frame) { roots.frameRoots.push_back(&frame); }
+    ~frameRoot() { roots.frameRoots.pop_back(); }
+};
 
-cell numberP(const cells& c) {
-    return c[0].type == Number ? trueSymbol : falseSymbol;
-}
+void collect();
+void markMachineRoots(); // the virtual machine's frames, see below
 
-cell listP(const cells& c) {
-    return c[0].type == List ? trueSymbol : falseSymbol;
+// collect if enough has been allocated; only call where all live values are rooted
+inline void gcPoll()
+{
+    if (!heap.inhibited && heap.allocatedSinceCollection >= heap.threshold)
+        collect();
 }
 
-cell addition(const cells& c)
+// a cons cell: a list is a chain of these linked through `cdr` and ended
+// by (), and lists share their tails rather than copying them
+struct pairObject : heapObject {
+    cell car;
+    cell cdr;
+    pairObject(const cell& car, const cell& cdr) : car(car), cdr(cdr) {}
+    void trace()
+    {
+        markCell(car);
+        markCell(cdr);
+    }
+};
+
+// a lambda made by either engine: analyzed `code` when running nodes,
+// `compiled` code when running the virtual machine
+struct lambdaObject : heapObject {
+    std::shared_ptr<lambdaNode> code; // parameters and analyzed body
+    std::shared_ptr<prototype> compiled; // parameters and bytecode
+    struct environment* environment; // where the lambda was defined
+    lambdaObject(const std::shared_ptr<lambdaNode>& code, struct environment* env) : code(code), environment(env) {}
+    lambdaObject(const std::shared_ptr<prototype>& compiled, struct environment* env) : compiled(compiled), environment(env) {}
+    void trace();
+};
+
+cell::cell(cellType type, std::string_view name) : type(type), sym(intern(name)) {}
+
+cell::cell(cellType type, const cell& car, const cell& cdr)
+    : type(type), object(track(new pairObject(car, cdr)))
 {
-    // parse the value of the first cell as a long integer
-    long long n(
-        atol(
-            c[0]
-            .value
-            .c_str()
-        ));
-    // adds up the 2 arguments of the `+` procedure
-    for (cellIterator i = c.begin() + 1; i != c.end(); ++i)
-        n += atol(i->value.c_str());
-    return cell(Number, stringify(n));
 }
 
-cell substraction(const cells& c)
+cell::cell(cellType type, cellSpan items) : type(type), object(0)
 {
-    long long n(
-        atol(c[0]
-	     .value
-	     .c_str()
-	    ));
-    for (cellIterator i = c.begin() + 1; i != c.end(); ++i)
-        n -= atol(i->value.c_str());
-    return cell(Number, stringify(n));
+    // built back to front, so each pair points at the list made so far
+    cell rest(List);
+    for (size_t i = items.size(); i-- > 0;)
+        rest = cell(List, items[i], rest);
+    object = rest.object;
 }
 
-cell multiplication(const cells& c)
+cell::cell(cellType type, const std::shared_ptr<lambdaNode>& code, struct environment* env)
+    : type(type), object(track(new lambdaObject(code, env)))
 {
-    long long n(1);
-    for (cellIterator i = c.begin(); i != c.end(); ++i)
-        n *= atol(i->value.c_str());
-    return cell(Number, stringify(n));
 }
 
-cell division(const cells& c)
+cell::cell(cellType type, const std::shared_ptr<prototype>& compiled, struct environment* env)
+    : type(type), object(track(new lambdaObject(compiled, env)))
 {
-    long long n(
-        atol(
-            c[0]
-            .value
-            .c_str()
-        ));
-    for (cellIterator i = c.begin() + 1; i != c.end(); ++i)
-        n /= atol(i->value.c_str());
-    return cell(Number, stringify(n));
 }
 
-cell logicOr(const cells& c) {
-    for (cellIterator i = c.begin(); i != c.end(); ++i)
-	if (i->value != falseSymbol.value)
-	    return trueSymbol;
-    return falseSymbol;
+const std::string& cell::name() const
+{
+    static const std::string empty;
+    return type == Symbol && sym ? sym->name : empty;
 }
 
-cell logicAnd(const cells& c) {
-    for (cellIterator i = c.begin(); i != c.end(); ++i)
-	if (i->value == falseSymbol.value)
-	    return falseSymbol;
-    return trueSymbol;
+cells cell::items() const
+{
+    cells result;
+    for (pairObject* p = pair(); p; p = p->cdr.pair())
+        result.push_back(p->car);
+    return result;
 }
 
-cell logicNot(const cells& c) {
-    if (c[0].value == falseSymbol.value)
-	return trueSymbol;
-    else
-	return falseSymbol;
+const cell falseSymbol(Symbol, "False");
+const cell trueSymbol(Symbol, "True"); // anything that isn't falseSymbol is true
+const cell NIL(List); // the empty list ()
+const cell spaceSymbol(Symbol, "\\s");
+const cell newlineSymbol(Symbol, "\\n");
+const cell whatTheFuck(Symbol, "");
+
+// the special forms, interned once so eval dispatches on pointer compares
+symbol* const quoteKeyword = intern("quote");
+symbol* const ifKeyword = intern("if");
+symbol* const setKeyword = intern("set!");
+symbol* const defineKeyword = intern("define");
+symbol* const lambdaKeyword = intern("lambda");
+symbol* const beginKeyword = intern("begin");
+symbol* const loadKeyword = intern("load");
+symbol* const defineMemoKeyword = intern("define-memo");
+
+// everything except the symbol False counts as true
+bool isFalse(const cell& c) {
+    return c.type == Symbol && c.sym == falseSymbol.sym;
 }
 
-cell greaterThan(const cells& c)
-{
-    long long n(
-        atol(
-            c[0]
-            .value
-            .c_str()
-	));
-    for (cellIterator i = c.begin() + 1; i != c.end(); ++i)
-        if (n <= atol(i->value.c_str()))
-            return falseSymbol;
-    return trueSymbol;
+////////////////////// environment
+
+// true for the default cell that marks a symbol without a global binding
+bool isUnbound(const cell& c) {
+    return c.type == Symbol && !c.sym;
 }
 
-cell lessThan(const cells& c)
+// the global environment: a view of the symbols' global value slots
+struct globalEnvironment {
+    cell& operator[] (const std::string& var)
+	{
+	    return intern(var)->value;
+	}
+};
+
+// the local variables of one lambda application: a flat array of slots
+// whose positions were fixed when the lambda was analyzed, chained to the
+// frame the lambda was defined in (0 when that is the global environment)
+struct alignas(cell) environment : heapObject {
+    environment* outer;
+    lambdaObject* lambda; // the lambda running in this frame keeps its code alive
+    size_t size;
+    cell* slots; // stored right after the frame, in the same allocation
+    bool stacked; // on the frame stack rather than the collected heap
+
+    // a frame of `size` slots, all (), for running `lambda`; see frameStack
+    // for when it may be `stacked`
+    static environment* make(size_t size, lambdaObject* lambda, bool stacked);
+
+    void trace()
+	{
+	    markObject(outer);
+	    markObject(lambda);
+	    for (size_t i = 0; i < size; ++i)
+		markCell(slots[i]);
+	}
+
+    // return the frame `depth` levels out from this one
+    environment* up(size_t depth)
+	{
+	    environment* frame = this;
+	    while (depth--)
+		frame = frame->outer;
+	    return frame;
+	}
+};
+
+// Most lambdas never capture their frame: only a lambda expression in the
+// body can keep a reference to it after the body has returned. Frames of
+// such lambdas are carved out of this stack instead of the collected heap,
+// and each run() loop gives back the frames it took when it tail-calls or
+// returns. Nothing else can point at them: closures are only created in
+// frames of capturing lambdas, and those are always on the heap.
+struct frameStack {
+    static const size_t chunkSize = 64 * 1024;
+    std::vector<char*> chunks;
+    size_t top; // offset of the first free byte, counted over all chunks
+    size_t base; // where the frames of the innermost run() loop begin
+
+    frameStack() : top(0), base(0) {}
+
+    void* allocate(size_t bytes)
+	{
+	    size_t chunk = top / chunkSize, offset = top % chunkSize;
+	    if (offset + bytes > chunkSize) {
+		++chunk;
+		offset = 0;
+	    }
+	    if (chunk == chunks.size())
+		chunks.push_back(static_cast<char*>(::operator new(chunkSize)));
+	    top = chunk * chunkSize + offset + bytes;
+	    return chunks[chunk] + offset;
+	}
+
+    // drop the frames of the innermost run() loop
+    void release() { top = base; }
+};
+
+thread_local frameStack frames;
+
+// the frames a run() loop allocates are released when it finishes
+struct frameScope {
+    size_t savedBase;
+    frameScope() : savedBase(frames.base) { frames.base = frames.top; }
+    ~frameScope()
+	{
+	    frames.top = frames.base;
+	    frames.base = savedBase;
+	}
+};
+
+environment* environment::make(size_t size, lambdaObject* lambda, bool stacked)
 {
-    long long n(
-        atol(
-            c[0]
-            .value
-            .c_str()
-        ));
-    for (cellIterator i = c.begin() + 1; i != c.end(); ++i)
-        if (n >= atol(i->value.c_str()))
-            return falseSymbol;
-    return trueSymbol;
+    size_t bytes = sizeof(environment) + size * sizeof(cell);
+    stacked = stacked && bytes <= frameStack::chunkSize / 4;
+    environment* frame = new (stacked ? frames.allocate(bytes) : ::operator new(bytes)) environment;
+    frame->outer = lambda->environment;
+    frame->lambda = lambda;
+    frame->size = size;
+    frame->slots = reinterpret_cast<cell*>(frame + 1);
+    frame->stacked = stacked;
+    for (size_t i = 0; i < size; ++i)
+        new (&frame->slots[i]) cell(NIL);
+    return stacked ? frame : track(frame, bytes);
 }
 
-cell lessOrEqualThan(const cells& c)
+void lambdaObject::trace()
 {
-    long long n(
-        atol(
-            c[0]
-            .value
-            .c_str()
-        ));
-    for (cellIterator i = c.begin() + 1; i != c.end(); ++i)
-        if (n > atol(i->value.c_str()))
-            return falseSymbol;
-    return trueSymbol;
+    markObject(environment);
 }
 
-cell greaterOrEqualThan(const cells& c)
+// mark everything reachable from the roots, then free the rest
+void collect()
 {
-    long long n(
-        atol(
-            c[0]
-            .value
-            .c_str()
-        ));
-    for (cellIterator i = c.begin() + 1; i != c.end(); ++i)
-        if (n < atol(i->value.c_str()))
-            return falseSymbol;
-    return trueSymbol;
-}
+    if (heap.inhibited)
+        return;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-cell equal(const cells& c) {
-    return c[0].value == c[1].value ? trueSymbol : falseSymbol;
-}
+    symbolTable& table = symbols();
+    for (symbolTable::iterator i = table.begin(); i != table.end(); ++i)
+        markCell(i->second->value);
+    for (rootedCell* r = rootedCell::first(); r; r = r->next)
+        markCell(r->value);
+    for (size_t i = 0; i < roots.cellRoots.size(); ++i)
+        markCell(*roots.cellRoots[i]);
+    for (size_t i = 0; i < roots.vectorRoots.size(); ++i)
+        for (cellIterator c = roots.vectorRoots[i]->begin(); c != roots.vectorRoots[i]->end(); ++c)
+            markCell(*c);
+    for (cell* c = values.base; c < values.top; ++c)
+        markCell(*c);
+    for (size_t i = 0; i < roots.frameRoots.size(); ++i) {
+        // a stacked frame isn't on the heap list, so trace it directly
+        environment* frame = *roots.frameRoots[i];
+        if (frame && frame->stacked)
+            frame->trace();
+        else
+            markObject(frame);
+    }
+    markMachineRoots();
+    while (!heap.gray.empty()) {
+        heapObject* object = heap.gray.back();
+        heap.gray.pop_back();
+        object->trace();
+    }
 
-cell length(const cells& c) {
-    return cell(Number, stringify(c[0].list.size()));
-}
-cell nullPointer(const cells& c) {
-    return c[0].list.empty() ? trueSymbol : falseSymbol;
-}
-cell car(const cells& c) {
-    return c[0].list[0];
+    size_t before = heap.heapBytes;
+    heapObject** link = &heap.objects;
+    while (heapObject* object = *link) {
+        if (object->marked) {
+            object->marked = false;
+            link = &object->next;
+        }
+        else {
+            *link = object->next;
+            heap.heapBytes -= size_t(object->bytes);
+            --heap.objectCount;
+            delete object;
+        }
+    }
+
+    heap.freedBytes += before - heap.heapBytes;
+    heap.allocatedSinceCollection = 0;
+    // let the heap grow to twice what survived before collecting again
+    heap.threshold = std::max<size_t>(4 << 20, heap.heapBytes);
+    ++heap.collections;
+    heap.lastPause = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    heap.maxPause = std::max(heap.maxPause, heap.lastPause);
+    heap.totalPause += heap.lastPause;
 }
 
-cell cdr(const cells& c)
+
+////////////////////// numbers
+
+// Integers are Numbers (fixnums, an int64_t in the cell) as long as they
+// fit; arithmetic that overflows moves on to Bignums, and a Bignum result
+// that fits in an int64_t goes back to being a Number, so each value has
+// exactly one representation. A Bignum's magnitude is stored in base 2^32,
+// least significant digit first, without leading zeros.
+//
+// Dividing integers gives an exact Rational (in lowest terms, with a
+// denominator above 1, so again one representation per value) and any
+// operation with a Real gives a Real, a double kept unboxed in the cell.
+
+typedef std::vector<uint32_t> digits;
+
+struct bignumObject : heapObject {
+    bool negative;
+    digits magnitude;
+    bignumObject(bool negative, digits magnitude) : negative(negative), magnitude(std::move(magnitude)) {}
+};
+
+// an integer being computed with, whatever its representation
+struct integer {
+    bool negative;
+    digits magnitude;
+};
+
+bool isInteger(const cell& c) { return c.type == Number || c.type == Bignum; }
+
+const bignumObject* bignum(const cell& c) { return static_cast<const bignumObject*>(c.object); }
+
+void trim(digits& d)
 {
-    if (c[0].list.size() < 2)
-        return NIL;
-    cell result(c[0]);
-    result.list.erase(result.list.begin());
-    return result;
+    while (!d.empty() && d.back() == 0)
+        d.pop_back();
 }
 
-cell append(const cells& c)
+integer toInteger(const cell& c)
 {
-    cell result(List);
-    result.list = c[0].list;
-    for (cellIterator i = c[1].list.begin(); i != c[1].list.end(); ++i)
-        result.list.push_back(*i);
-    return result;
+    integer n;
+    if (c.type == Bignum) {
+        n.negative = bignum(c)->negative;
+        n.magnitude = bignum(c)->magnitude;
+        return n;
+    }
+    int64_t value = c.type == Number ? c.number : 0;
+    n.negative = value < 0;
+    uint64_t m = n.negative ? 0 - uint64_t(value) : uint64_t(value);
+    if (m)
+        n.magnitude.push_back(uint32_t(m));
+    if (m >> 32)
+        n.magnitude.push_back(uint32_t(m >> 32));
+    return n;
 }
 
-
-cell cons(const cells& c)
+// a Number if it fits, a Bignum otherwise
+cell makeInteger(integer n)
 {
-    cell result(List);
-    result.list.push_back(c[0]);
-    /* for (cellIterator i = c[1].list.begin(); i != c[1].list.end(); i++)
-       result.list.push_back(*i);*/
-    result.list.push_back(c[1]);
-    return result;
+    trim(n.magnitude);
+    if (n.magnitude.size() <= 2) {
+        uint64_t m = n.magnitude.empty() ? 0 : n.magnitude[0];
+        if (n.magnitude.size() == 2)
+            m |= uint64_t(n.magnitude[1]) << 32;
+        if (m <= uint64_t(INT64_MAX))
+            return cell(Number, n.negative ? -int64_t(m) : int64_t(m));
+        if (n.negative && m == uint64_t(INT64_MAX) + 1)
+            return cell(Number, INT64_MIN);
+    }
+    cell c(Bignum);
+    size_t bytes = sizeof(bignumObject) + n.magnitude.size() * sizeof(uint32_t);
+    c.object = track(new bignumObject(n.negative, std::move(n.magnitude)), bytes);
+    return c;
 }
 
-cell list(const cells& c)
+int compareMagnitudes(const digits& a, const digits& b)
 {
-    cell result(List);
-    result.list = c;
-    return result;
+    if (a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0;)
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
 }
 
-cell display(const cells& c)
+digits addMagnitudes(const digits& a, const digits& b)
 {
-    if (c[0].value == "\\n")
-        std::cout << '\n';
-    else if (c[0].value == "\\s")
-        std::cout << ' ';
-    else std::cout << c[0].value;
-    return whatTheFuck;
+    const digits& longer = a.size() < b.size() ? b : a;
+    const digits& shorter = a.size() < b.size() ? a : b;
+    digits sum(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.size(); ++i) {
+        carry += uint64_t(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+        sum[i] = uint32_t(carry);
+        carry >>= 32;
+    }
+    sum[longer.size()] = uint32_t(carry);
+    trim(sum);
+    return sum;
 }
 
-cell exitCode(const cells& c)
+// a - b, where a >= b
+digits subtractMagnitudes(const digits& a, const digits& b)
 {
-    exit(0);
+    digits difference(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        int64_t d = int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = d < 0;
+        difference[i] = uint32_t(d + (borrow << 32));
+    }
+    trim(difference);
+    return difference;
 }
 
-// define the bare minimum set of primintives necessary to pass the unit tests
-void addGlobals(environment& env)
+digits schoolbookMultiply(const digits& a, const digits& b)
 {
-    
-    env["nil"] = NIL;   env["False"] = falseSymbol;  env["True"] = trueSymbol;
-    env["\\s"] = spaceSymbol; env["\\n"] = newlineSymbol;
-    env["display"] = cell(&display); env["exit"] = cell(&exitCode);
-    env["append"] = cell(&append);   env["car"] = cell(&car);
-    env["cdr"] = cell(&cdr);      env["cons"] = cell(&cons);
-    env["length"] = cell(&length);   env["list"] = cell(&list);
-    env["null?"] = cell(&nullPointer);    env["+"] = cell(&addition);
-    env["-"] = cell(&substraction);      env["*"] = cell(&multiplication);
-    env["/"] = cell(&division);      env[">"] = cell(&greaterThan);
-    env["<"] = cell(&lessThan);     env["<="] = cell(&lessOrEqualThan);
-    env[">="] = cell(&greaterOrEqualThan);
-    env["="] = cell(&equal); env["symbol?"] = cell(&symbolP);
-    env["number?"] = cell(&numberP); env["list?"] = cell(&listP);
-    env["or"] = cell(&logicOr); env["and"] = cell(&logicAnd);
-    env["not"] = cell(&logicNot);
+    digits product(a.size() + b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); ++j) {
+            carry += uint64_t(a[i]) * b[j] + product[i + j];
+            product[i + j] = uint32_t(carry);
+            carry >>= 32;
+        }
+        product[i + b.size()] = uint32_t(carry);
+    }
+    trim(product);
+    return product;
 }
 
-
-////////////////////// eval
-
-void loadFile(const std::string& name, environment* env);
-
-cell eval(cell x, environment* env)
+// add x * 2^(32 * shift) into `sum`, which is long enough
+void addShifted(digits& sum, const digits& x, size_t shift)
 {
-    if (x.type == Symbol)
-        return env->find(x.value)[x.value];
-    if (x.type == Number)
-        return x;
-    if (x.list.empty())
-        return NIL;
-    if (x.list[0].type == Symbol) {
-        if (x.list[0].value == "quote")       // (quote exp)
-            return x.list[1];
-        if (x.list[0].value == "if")          // (if test conseq [alt])
-            return eval(eval(x.list[1], env).value == "False" ? (x.list.size() < 4 ? NIL : x.list[3]) : x.list[2], env);
-        if (x.list[0].value == "set!")        // (set! var exp)
-            return env->find(x.list[1].value)[x.list[1].value] = eval(x.list[2], env);
-        if (x.list[0].value == "define")      // (define var exp)
-            return (*env)[x.list[1].value] = eval(x.list[2], env);
-        if (x.list[0].value == "lambda") {    // (lambda (var*) exp)
-            x.type = Lambda;
-            // keep a reference to the environment that exists now (when the
-            // lambda is being defined) because that's the outer environment
-            // we'll need to use when the lambda is executed
-            x.environment = env;
-            return x;
-        }
-        if (x.list[0].value == "begin") {     // (begin exp*)
-            for (size_t i = 1; i < x.list.size() - 1; ++i)
-                eval(x.list[i], env);
-            return eval(x.list[x.list.size() - 1], env);
-        }
-	if (x.list[0].value == "load") {      // (load file-symbol)
-	    if (x.list.size() == 2) {
-		cell name = eval(x.list[1], env);
-		if (name.value == "nil")
-		    return falseSymbol;
-		else {
-		    loadFile(name.value, env);
-		    return trueSymbol;
-		}
-	    }
-	    else
-		return falseSymbol;
-	}
+    uint64_t carry = 0;
+    for (size_t i = 0; i < x.size() || carry; ++i) {
+        carry += uint64_t(sum[i + shift]) + (i < x.size() ? x[i] : 0);
+        sum[i + shift] = uint32_t(carry);
+        carry >>= 32;
     }
-    // (proc exp*)
-    cell proc(eval(x.list[0], env));
-    cells exps;
-    for (cell::iterator exp = x.list.begin() + 1; exp != x.list.end(); ++exp)
-        exps.push_back(eval(*exp, env));
-    if (proc.type == Lambda) {
-        // Create an environment for the execution of this lambda function
-        // where the outer environment is the one that existed* at the time
-        // the lambda was defined and the new inner associations are the
-        // parameter names with the given arguments.
-        // *Although the environmet existed at the time the lambda was defined
-        // it wasn't necessarily complete - it may have subsequently had
-        // more symbols defined in that environment.
-        return eval(/*body*/proc.list[2], new environment(/*parms*/proc.list[1].list, /*args*/exps, proc.environment));
-    }
-    else if (proc.type == Proc)
-        return proc.proc(exps);
-
-    std::cout << "not a function\n";
-    return NIL;
 }
 
+// below this many digits the schoolbook method is faster
+const size_t karatsubaThreshold = 32;
 
-////////////////////// parse, read and user interaction
+// Karatsuba: with a = a1 B + a0 and b = b1 B + b0, a b is
+// z2 B^2 + z1 B + z0 where z2 = a1 b1, z0 = a0 b0 and
+// z1 = (a0 + a1)(b0 + b1) - z2 - z0: three half-size products instead of four
+digits multiplyMagnitudes(const digits& a, const digits& b)
+{
+    if (a.size() < karatsubaThreshold || b.size() < karatsubaThreshold)
+        return schoolbookMultiply(a, b);
+    size_t half = std::max(a.size(), b.size()) / 2;
+    digits a0(a.begin(), a.begin() + std::min(half, a.size())), a1;
+    digits b0(b.begin(), b.begin() + std::min(half, b.size())), b1;
+    if (a.size() > half)
+        a1.assign(a.begin() + half, a.end());
+    if (b.size() > half)
+        b1.assign(b.begin() + half, b.end());
+    trim(a0);
+    trim(b0);
+    digits z0 = multiplyMagnitudes(a0, b0);
+    digits z2 = multiplyMagnitudes(a1, b1);
+    digits z1 = multiplyMagnitudes(addMagnitudes(a0, a1), addMagnitudes(b0, b1));
+    z1 = subtractMagnitudes(subtractMagnitudes(z1, z2), z0);
+    digits product(a.size() + b.size() + 1);
+    addShifted(product, z0, 0);
+    addShifted(product, z1, half);
+    addShifted(product, z2, 2 * half);
+    trim(product);
+    return product;
+}
 
-// whitespace predicate
-bool whitespace(char c) {
-    return c == ' ' || c == '\n' || c == '\t' || c == '\r' ? 1 : 0; }
+// divide in place by a single digit; return the remainder
+uint32_t divideBySmall(digits& a, uint32_t divisor)
+{
+    uint64_t remainder = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+        uint64_t current = (remainder << 32) | a[i];
+        a[i] = uint32_t(current / divisor);
+        remainder = current % divisor;
+    }
+    trim(a);
+    return uint32_t(remainder);
+}
 
-// convert given string to list of tokens
-std::list<std::string> tokenize(const std::string& str)
+// schoolbook long division (Knuth's algorithm D): a = q b + r, b not 0
+void divideMagnitudes(const digits& a, const digits& b, digits& q, digits& r)
 {
-    std::list<std::string> tokens;
-    const char* s = str.c_str();
-    while (*s) {
-        while (whitespace(*s))
-	    ++s;
-        if (*s == '(' || *s == ')')
-	    tokens.push_back(*s++ == '(' ? "(" : ")");
-	else if (*s == '\'') {
-	    ++s;
-	    tokens.push_back("'");
-	}
-        else {
-            const char* t = s;
-            while (*t && *t != ' ' && *t != '(' && *t != ')')
-                ++t;
-            tokens.push_back(std::string(s, t));
-            s = t;
+    if (compareMagnitudes(a, b) < 0) {
+        q.clear();
+        r = a;
+        return;
+    }
+    if (b.size() == 1) {
+        q = a;
+        uint32_t remainder = divideBySmall(q, b[0]);
+        r.assign(remainder ? 1 : 0, remainder);
+        return;
+    }
+    // normalize so the divisor's top digit has its high bit set, which
+    // keeps each estimated quotient digit at most 2 too large
+    int shift = 0;
+    while (!(b.back() << shift & 0x80000000u))
+        ++shift;
+    size_t n = b.size(), m = a.size() - n;
+    digits v(n), u(a.size() + 1);
+    for (size_t i = n; i-- > 0;)
+        v[i] = b[i] << shift | (shift && i ? b[i - 1] >> (32 - shift) : 0);
+    u[a.size()] = shift ? a.back() >> (32 - shift) : 0;
+    for (size_t i = a.size(); i-- > 0;)
+        u[i] = a[i] << shift | (shift && i ? a[i - 1] >> (32 - shift) : 0);
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t numerator = uint64_t(u[j + n]) << 32 | u[j + n - 1];
+        uint64_t qhat = numerator / v[n - 1], rhat = numerator % v[n - 1];
+        while (qhat >> 32 || qhat * v[n - 2] > (rhat << 32 | u[j + n - 2])) {
+            --qhat;
+            rhat += v[n - 1];
+            if (rhat >> 32)
+                break;
+        }
+        // u[j .. j + n] -= qhat * v
+        int64_t borrow = 0, t;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t p = qhat * v[i];
+            t = int64_t(u[i + j]) - borrow - int64_t(p & 0xffffffffu);
+            u[i + j] = uint32_t(t);
+            borrow = int64_t(p >> 32) - (t >> 32);
+        }
+        t = int64_t(u[j + n]) - borrow;
+        u[j + n] = uint32_t(t);
+        q[j] = uint32_t(qhat);
+        if (t < 0) {
+            // qhat was one too large: add v back
+            --q[j];
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; ++i) {
+                carry += uint64_t(u[i + j]) + v[i];
+                u[i + j] = uint32_t(carry);
+                carry >>= 32;
+            }
+            u[j + n] += uint32_t(carry);
         }
     }
-    return tokens;
+    r.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        r[i] = u[i] >> shift | (shift ? u[i + 1] << (32 - shift) : 0);
+    trim(q);
+    trim(r);
 }
 
-// numbers become Numbers; every other token is a Symbol
-cell atom(const std::string& token)
+integer addIntegers(const integer& a, const integer& b)
 {
-    if (isDigit(token[0]) || (token[0] == '-' && isDigit(token[1])))
-        return cell(Number, token);
-    return cell(Symbol, token);
+    integer sum;
+    if (a.negative == b.negative) {
+        sum.negative = a.negative;
+        sum.magnitude = addMagnitudes(a.magnitude, b.magnitude);
+    }
+    else if (compareMagnitudes(a.magnitude, b.magnitude) >= 0) {
+        sum.negative = a.negative;
+        sum.magnitude = subtractMagnitudes(a.magnitude, b.magnitude);
+    }
+    else {
+        sum.negative = b.negative;
+        sum.magnitude = subtractMagnitudes(b.magnitude, a.magnitude);
+    }
+    return sum;
 }
 
-cell quoteForm(const cell& form) {
-	cell c(List);
-	cell quote(Symbol, "quote");
-	c.list.push_back(quote);
-	c.list.push_back(form);
-	return c;
-}
-
-// return the Lisp expression in the given tokens
-cell readFrom(std::list<std::string>& tokens)
-{
-    // get the first token of this expression (it should be a `(`)
-    const std::string token(tokens.front());
-    // remove the first token, as it's supposed to be a `(`
-    tokens.pop_front();
-
-    // this means this is a quote expression
-    if (token == "'")
-        return quoteForm(readFrom(tokens));
-
-    // this must mean it is indeed an expression
-    if (token == "(") {
-        cell c(List);
-        // continuously consume tokens until we reach `)` (which means the expression is finished)
-        while (tokens.front() != ")")
-            // pushes tokens into a Lisp expression/cell type
-            c.list.push_back(readFrom(tokens));
-        // due to recursion  ^^^^^^^^ above, this pops all the tokens after they were successfully consumed
-        tokens.pop_front();
-        return c;
-    }
-    if (token == "")
-      return falseSymbol;
-    // no `(`, it might be an atom, be it a number or a symbol
-    else
-        return atom(token);
+int compareIntegers(const integer& a, const integer& b)
+{
+    if (a.negative != b.negative)
+        return a.negative ? -1 : 1;
+    int c = compareMagnitudes(a.magnitude, b.magnitude);
+    return a.negative ? -c : c;
 }
 
-// return the Lisp expression represented by the given string
-cell read(const std::string& s)
+// the decimal digits of an integer, nine at a time
+std::string integerToString(integer n)
 {
-    // tokenizes the string
-    std::list<std::string> tokens(tokenize(s));
-    // tokens -> Lisp expression
-    return readFrom(tokens);
+    std::vector<uint32_t> chunks; // base 10^9, least significant first
+    while (!n.magnitude.empty())
+        chunks.push_back(divideBySmall(n.magnitude, 1000000000u));
+    if (chunks.empty())
+        return "0";
+    std::string s(n.negative ? "-" : "");
+    s += std::to_string(chunks.back());
+    char buffer[10];
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        snprintf(buffer, sizeof(buffer), "%09u", chunks[i]);
+        s += buffer;
+    }
+    return s;
 }
 
-// convert given cell to a Lisp-readable string
-std::string toString(const cell& exp)
+// parse an optionally signed run of decimal digits, nine at a time
+cell parseInteger(std::string_view text)
 {
-    if (exp.type == List) {
-        std::string s("(");
-        // adds elements of the list as part of the output when evaluated
-        for (cell::iterator e = exp.list.begin(); e != exp.list.end(); ++e)
-            s += toString(*e) + ' ';
-        // truncate last list item if it's somehow a whitespace
-        if (s[s.size() - 1] == ' ')
-            s.erase(s.size() - 1);
-        // add closing bracket
-        return s + ')';
+    integer n;
+    n.negative = text[0] == '-';
+    size_t i = n.negative || text[0] == '+' ? 1 : 0;
+    while (i < text.size()) {
+        size_t length = std::min<size_t>(9, text.size() - i);
+        uint32_t chunk = 0, scale = 1;
+        for (size_t k = 0; k < length; ++k, ++i) {
+            chunk = chunk * 10 + uint32_t(text[i] - '0');
+            scale *= 10;
+        }
+        // n = n * scale + chunk
+        uint64_t carry = chunk;
+        for (size_t k = 0; k < n.magnitude.size(); ++k) {
+            carry += uint64_t(n.magnitude[k]) * scale;
+            n.magnitude[k] = uint32_t(carry);
+            carry >>= 32;
+        }
+        if (carry)
+            n.magnitude.push_back(uint32_t(carry));
     }
-    // shows that a lambda was defined
-    else if (exp.type == Lambda)
-        return "<Lambda>";
-    // shows a procedure was defined
-    else if (exp.type == Proc)
-        return "<Proc>";
-    // if it's not a list, lambda, or procedure, it must be an atom (symbol or number)
-    return exp.value;
+    return makeInteger(n);
+}
+
+// Number arithmetic that doesn't overflow stays in registers; everything
+// else goes through the integers above.
+#if defined(__GNUC__)
+inline bool addOverflows(int64_t a, int64_t b, int64_t& r) { return __builtin_add_overflow(a, b, &r); }
+inline bool subtractOverflows(int64_t a, int64_t b, int64_t& r) { return __builtin_sub_overflow(a, b, &r); }
+inline bool multiplyOverflows(int64_t a, int64_t b, int64_t& r) { return __builtin_mul_overflow(a, b, &r); }
+#else
+inline bool addOverflows(int64_t a, int64_t b, int64_t& r)
+{
+    r = int64_t(uint64_t(a) + uint64_t(b));
+    return (a >= 0) == (b >= 0) && (r >= 0) != (a >= 0);
+}
+inline bool subtractOverflows(int64_t a, int64_t b, int64_t& r)
+{
+    r = int64_t(uint64_t(a) - uint64_t(b));
+    return (a >= 0) != (b >= 0) && (r >= 0) != (a >= 0);
 }
+inline bool multiplyOverflows(int64_t a, int64_t b, int64_t& r)
+{
+    r = int64_t(uint64_t(a) * uint64_t(b));
+    return a != 0 && (r / a != b || (a == -1 && b == INT64_MIN));
+}
+#endif
 
+struct rationalObject : heapObject {
+    cell numerator; // an integer
+    cell denominator; // an integer above 1
+    rationalObject(const cell& numerator, const cell& denominator) : numerator(numerator), denominator(denominator) {}
+    void trace()
+    {
+        markCell(numerator);
+        markCell(denominator);
+    }
+};
 
-///////////////////// fixed parse, read & user interaction
+bool isNumber(const cell& c) { return isInteger(c) || c.type == Rational || c.type == Real; }
 
-std::string fetch(std::istream& input);
+const rationalObject* rational(const cell& c) { return static_cast<const rationalObject*>(c.object); }
 
-// skip huwitespace
-void skipWhite(std::istream& input) {
-    char peek = '\0';
-    input.get(peek);
-    while(whitespace(peek))
-        input.get(peek);
-    input.unget();
+cell makeReal(double d)
+{
+    cell c(Real);
+    c.real = d;
+    return c;
 }
 
-// fetch a string from the input stream
-std::string fetch(std::istream& input) {
-    char peek = '\0';
-    std::string string;
+cell numeratorOf(const cell& c) { return c.type == Rational ? rational(c)->numerator : c; }
+cell denominatorOf(const cell& c) { return c.type == Rational ? rational(c)->denominator : cell(Number, int64_t(1)); }
 
-    input.get(peek);
-    if (peek == '\'')
-        return std::string("'") += fetch(input);
-    if (peek == '(') {
-        int depth = 1;
-        string.push_back(peek);
-        input.get(peek);
-        while(depth >= 1) {
-            if (peek == '(') {
-                string.push_back(peek);
-                input.get(peek);
-                depth += 1;
-            }
-            if (peek == ')') {
-                string.push_back(peek);
-                input.get(peek);
-                depth -= 1;
-            }
-            else {
-                string.push_back(peek);
-                input.get(peek);
-            }
-        }
+bool isZero(const cell& c) { return (c.type == Number && c.number == 0) || (c.type == Real && c.real == 0); }
+
+bool isNegative(const cell& c)
+{
+    switch (c.type) {
+    case Number: return c.number < 0;
+    case Bignum: return bignum(c)->negative;
+    case Rational: return isNegative(rational(c)->numerator);
+    case Real: return c.real < 0;
+    default: return false;
     }
-    else if (whitespace(peek)) {
-        input.unget();
-        skipWhite(input);
-        return fetch(input);
+}
+
+double toReal(const cell& c)
+{
+    switch (c.type) {
+    case Number:
+        return double(c.number);
+    case Bignum: {
+        const bignumObject* n = bignum(c);
+        double d = 0;
+        for (size_t i = n->magnitude.size(); i-- > 0;)
+            d = d * 4294967296.0 + n->magnitude[i];
+        return n->negative ? -d : d;
     }
-    else while (!whitespace(peek) && peek != '(' && peek != ')') {
-        string.push_back(peek);
-        input.get(peek);
+    case Rational:
+        return toReal(rational(c)->numerator) / toReal(rational(c)->denominator);
+    case Real:
+        return c.real;
+    default:
+        return 0;
     }
-    return string;
 }
 
-// read a file
-std::string readFile(const std::string& name) {
-	std::ifstream input(name);
-	std::stringstream buffer;
-	buffer << input.rdbuf();
-	input.close();
-	std::string output = buffer.str();
-	return output;
-}
+inline cell add(const cell& a, const cell& b);
+inline cell subtract(const cell& a, const cell& b);
+inline cell multiply(const cell& a, const cell& b);
 
-// load a file
-void loadFile(const std::string& name, environment* env) {
-	std::string data = readFile(name);
-	std::list<std::string> tokens = tokenize(data);
-	while (!tokens.empty()) {
-	    cell object = readFrom(tokens);
-	    eval(object, env);
-	}
+// the truncated quotient and the remainder (with the sign of a) of two
+// integers, b not 0; either result may be skipped
+void divideIntegers(const cell& a, const cell& b, cell* quotient, cell* remainder)
+{
+    if (a.type == Number && b.type == Number && !(a.number == INT64_MIN && b.number == -1)) {
+        if (quotient)
+            *quotient = cell(Number, a.number / b.number);
+        if (remainder)
+            *remainder = cell(Number, a.number % b.number);
+        return;
+    }
+    integer x = toInteger(a), y = toInteger(b), q, r;
+    divideMagnitudes(x.magnitude, y.magnitude, q.magnitude, r.magnitude);
+    q.negative = x.negative != y.negative;
+    r.negative = x.negative;
+    if (quotient)
+        *quotient = makeInteger(q);
+    if (remainder)
+        *remainder = makeInteger(r);
 }
 
-// the default read-eval-print-loop
-void repl(const std::string& prompt, environment* env)
+// the greatest common divisor of two integers, not both 0
+cell greatestCommonDivisor(cell a, cell b)
 {
+    if (a.type == Number && b.type == Number) {
+        uint64_t x = a.number < 0 ? 0 - uint64_t(a.number) : uint64_t(a.number);
+        uint64_t y = b.number < 0 ? 0 - uint64_t(b.number) : uint64_t(b.number);
+        while (y) {
+            uint64_t t = x % y;
+            x = y;
+            y = t;
+        }
+        integer g;
+        g.negative = false;
+        g.magnitude.push_back(uint32_t(x));
+        g.magnitude.push_back(uint32_t(x >> 32));
+        return makeInteger(g);
+    }
+    while (!isZero(b)) {
+        cell r;
+        divideIntegers(a, b, 0, &r);
+        a = b;
+        b = r;
+    }
+    return isNegative(a) ? subtract(cell(Number, int64_t(0)), a) : a;
+}
+
+// n/d in lowest terms, an integer if that's what it comes to; d not 0
+cell makeRational(cell n, cell d)
+{
+    if (isNegative(d)) {
+        n = subtract(cell(Number, int64_t(0)), n);
+        d = subtract(cell(Number, int64_t(0)), d);
+    }
+    cell g = greatestCommonDivisor(n, d);
+    if (!(g.type == Number && g.number == 1)) {
+        divideIntegers(n, g, &n, 0);
+        divideIntegers(d, g, &d, 0);
+    }
+    if (d.type == Number && d.number == 1)
+        return n;
+    cell c(Rational);
+    c.object = track(new rationalObject(n, d));
+    return c;
+}
+
+// the slow paths of add, subtract, multiply and compareNumbers, kept out
+// of line: a Real makes the result a Real, otherwise a Rational makes it
+// exact fraction arithmetic, otherwise these are integers
+cell addLarge(const cell& a, const cell& b)
+{
+    if (a.type == Real || b.type == Real)
+        return makeReal(toReal(a) + toReal(b));
+    if (a.type == Rational || b.type == Rational)
+        return makeRational(add(multiply(numeratorOf(a), denominatorOf(b)), multiply(numeratorOf(b), denominatorOf(a))),
+                            multiply(denominatorOf(a), denominatorOf(b)));
+    return makeInteger(addIntegers(toInteger(a), toInteger(b)));
+}
+
+cell subtractLarge(const cell& a, const cell& b)
+{
+    if (a.type == Real || b.type == Real)
+        return makeReal(toReal(a) - toReal(b));
+    if (a.type == Rational || b.type == Rational)
+        return makeRational(subtract(multiply(numeratorOf(a), denominatorOf(b)), multiply(numeratorOf(b), denominatorOf(a))),
+                            multiply(denominatorOf(a), denominatorOf(b)));
+    integer negated = toInteger(b);
+    negated.negative = !negated.negative;
+    return makeInteger(addIntegers(toInteger(a), negated));
+}
+
+cell multiplyLarge(const cell& a, const cell& b)
+{
+    if (a.type == Real || b.type == Real)
+        return makeReal(toReal(a) * toReal(b));
+    if (a.type == Rational || b.type == Rational)
+        return makeRational(multiply(numeratorOf(a), numeratorOf(b)), multiply(denominatorOf(a), denominatorOf(b)));
+    integer x = toInteger(a), y = toInteger(b), product;
+    product.negative = x.negative != y.negative;
+    product.magnitude = multiplyMagnitudes(x.magnitude, y.magnitude);
+    return makeInteger(product);
+}
+
+int compareLarge(const cell& a, const cell& b)
+{
+    if (a.type == Real || b.type == Real) {
+        double x = toReal(a), y = toReal(b);
+        return x < y ? -1 : x > y;
+    }
+    if (a.type == Rational || b.type == Rational)
+        return compareIntegers(toInteger(multiply(numeratorOf(a), denominatorOf(b))),
+                               toInteger(multiply(numeratorOf(b), denominatorOf(a))));
+    return compareIntegers(toInteger(a), toInteger(b));
+}
+
+inline cell add(const cell& a, const cell& b)
+{
+    int64_t r;
+    if (a.type == Number && b.type == Number && !addOverflows(a.number, b.number, r))
+        return cell(Number, r);
+    return addLarge(a, b);
+}
+
+inline cell subtract(const cell& a, const cell& b)
+{
+    int64_t r;
+    if (a.type == Number && b.type == Number && !subtractOverflows(a.number, b.number, r))
+        return cell(Number, r);
+    return subtractLarge(a, b);
+}
+
+inline cell multiply(const cell& a, const cell& b)
+{
+    int64_t r;
+    if (a.type == Number && b.type == Number && !multiplyOverflows(a.number, b.number, r))
+        return cell(Number, r);
+    return multiplyLarge(a, b);
+}
+
+// exact unless a Real is involved; () after dividing by an exact 0
+cell divide(const cell& a, const cell& b)
+{
+    if (a.type == Real || b.type == Real)
+        return makeReal(toReal(a) / toReal(b));
+    if (isZero(b) || !isNumber(b)) {
+        std::cout << "division by zero\n";
+        return NIL;
+    }
+    if (a.type == Number && b.type == Number && b.number != -1 && a.number % b.number == 0)
+        return cell(Number, a.number / b.number);
+    return makeRational(multiply(numeratorOf(a), denominatorOf(b)), multiply(denominatorOf(a), numeratorOf(b)));
+}
+
+// -1, 0 or 1 as a is less than, equal to or greater than b
+inline int compareNumbers(const cell& a, const cell& b)
+{
+    if (a.type == Number && b.type == Number)
+        return a.number < b.number ? -1 : a.number > b.number;
+    return compareLarge(a, b);
+}
+
+// the shortest text that reads back as the same double, always with a
+// decimal point or exponent so that it reads back as a Real
+std::string realToString(double d)
+{
+    char buffer[32];
+    std::to_chars_result printed = std::to_chars(buffer, buffer + sizeof(buffer), d);
+    std::string s(buffer, printed.ptr);
+    if (s.find_first_of(".en") == std::string::npos)
+        s += ".0";
+    return s;
+}
+
+
+////////////////////// numeric vectors
+
+// An f64vector keeps its elements unboxed and contiguous, so the bulk
+// primitives below run as tight loops over doubles instead of applying
+// + to one cell at a time. The kernels are written once against a few
+// lane operations, which are AVX or SSE2 where the compiler targets them
+// and plain doubles otherwise; each keeps several accumulators so that
+// consecutive additions don't wait on one another.
+
+#if defined(__AVX__)
+typedef __m256d lanes;
+const size_t laneCount = 4;
+inline lanes loadLanes(const double* p) { return _mm256_loadu_pd(p); }
+inline void storeLanes(double* p, lanes v) { _mm256_storeu_pd(p, v); }
+inline lanes splatLanes(double d) { return _mm256_set1_pd(d); }
+inline lanes addLanes(lanes a, lanes b) { return _mm256_add_pd(a, b); }
+inline lanes multiplyLanes(lanes a, lanes b) { return _mm256_mul_pd(a, b); }
+inline lanes maxLanes(lanes a, lanes b) { return _mm256_max_pd(a, b); }
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+typedef __m128d lanes;
+const size_t laneCount = 2;
+inline lanes loadLanes(const double* p) { return _mm_loadu_pd(p); }
+inline void storeLanes(double* p, lanes v) { _mm_storeu_pd(p, v); }
+inline lanes splatLanes(double d) { return _mm_set1_pd(d); }
+inline lanes addLanes(lanes a, lanes b) { return _mm_add_pd(a, b); }
+inline lanes multiplyLanes(lanes a, lanes b) { return _mm_mul_pd(a, b); }
+inline lanes maxLanes(lanes a, lanes b) { return _mm_max_pd(a, b); }
+#else
+typedef double lanes;
+const size_t laneCount = 1;
+inline lanes loadLanes(const double* p) { return *p; }
+inline void storeLanes(double* p, lanes v) { *p = v; }
+inline lanes splatLanes(double d) { return d; }
+inline lanes addLanes(lanes a, lanes b) { return a + b; }
+inline lanes multiplyLanes(lanes a, lanes b) { return a * b; }
+inline lanes maxLanes(lanes a, lanes b) { return a < b ? b : a; }
+#endif
+
+inline double sumLanes(lanes v)
+{
+    double lane[laneCount];
+    storeLanes(lane, v);
+    double total = 0;
+    for (size_t i = 0; i < laneCount; ++i)
+        total += lane[i];
+    return total;
+}
+
+double sumDoubles(const double* x, size_t n)
+{
+    lanes s0 = splatLanes(0), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 4 * laneCount <= n; i += 4 * laneCount) {
+        s0 = addLanes(s0, loadLanes(x + i));
+        s1 = addLanes(s1, loadLanes(x + i + laneCount));
+        s2 = addLanes(s2, loadLanes(x + i + 2 * laneCount));
+        s3 = addLanes(s3, loadLanes(x + i + 3 * laneCount));
+    }
+    double total = sumLanes(addLanes(addLanes(s0, s1), addLanes(s2, s3)));
+    for (; i < n; ++i)
+        total += x[i];
+    return total;
+}
+
+double dotDoubles(const double* x, const double* y, size_t n)
+{
+    lanes s0 = splatLanes(0), s1 = s0, s2 = s0, s3 = s0;
+    size_t i = 0;
+    for (; i + 4 * laneCount <= n; i += 4 * laneCount) {
+        s0 = addLanes(s0, multiplyLanes(loadLanes(x + i), loadLanes(y + i)));
+        s1 = addLanes(s1, multiplyLanes(loadLanes(x + i + laneCount), loadLanes(y + i + laneCount)));
+        s2 = addLanes(s2, multiplyLanes(loadLanes(x + i + 2 * laneCount), loadLanes(y + i + 2 * laneCount)));
+        s3 = addLanes(s3, multiplyLanes(loadLanes(x + i + 3 * laneCount), loadLanes(y + i + 3 * laneCount)));
+    }
+    double total = sumLanes(addLanes(addLanes(s0, s1), addLanes(s2, s3)));
+    for (; i < n; ++i)
+        total += x[i] * y[i];
+    return total;
+}
+
+// n > 0
+double maxDoubles(const double* x, size_t n)
+{
+    lanes m = splatLanes(x[0]);
+    size_t i = 0;
+    for (; i + laneCount <= n; i += laneCount)
+        m = maxLanes(m, loadLanes(x + i));
+    double lane[laneCount];
+    storeLanes(lane, m);
+    double best = lane[0];
+    for (size_t l = 1; l < laneCount; ++l)
+        best = std::max(best, lane[l]);
+    for (; i < n; ++i)
+        best = std::max(best, x[i]);
+    return best;
+}
+
+// out[i] = x[i] + y[i], or x[i] + *y for every i when yStep is 0
+void addDoubles(const double* x, const double* y, size_t yStep, double* out, size_t n)
+{
+    size_t i = 0;
+    if (yStep) {
+        for (; i + laneCount <= n; i += laneCount)
+            storeLanes(out + i, addLanes(loadLanes(x + i), loadLanes(y + i)));
+    }
+    else {
+        lanes scalar = splatLanes(*y);
+        for (; i + laneCount <= n; i += laneCount)
+            storeLanes(out + i, addLanes(loadLanes(x + i), scalar));
+    }
+    for (; i < n; ++i)
+        out[i] = x[i] + y[i * yStep];
+}
+
+struct f64vectorObject : heapObject {
+    std::vector<double> elements;
+    f64vectorObject(size_t n, double fill) : elements(n, fill) {}
+};
+
+f64vectorObject* f64vector(const cell& c) { return c.type == F64Vector ? static_cast<f64vectorObject*>(c.object) : 0; }
+
+cell makeF64Vector(size_t n, double fill)
+{
+    cell c(F64Vector);
+    c.object = track(new f64vectorObject(n, fill), sizeof(f64vectorObject) + n * sizeof(double));
+    return c;
+}
+
+// argument i as an f64vector, or 0 after complaining
+f64vectorObject* vectorArgument(cellSpan c, size_t i, const char* name)
+{
+    f64vectorObject* v = i < c.size() ? f64vector(c[i]) : 0;
+    if (!v)
+        std::cout << name << " needs an f64vector\n";
+    return v;
+}
+
+// the element index of argument i, or -1 after complaining
+int64_t indexArgument(cellSpan c, size_t i, const f64vectorObject* v, const char* name)
+{
+    if (i < c.size() && c[i].type == Number && c[i].number >= 0 && uint64_t(c[i].number) < v->elements.size())
+        return c[i].number;
+    std::cout << name << ": index out of range\n";
+    return -1;
+}
+
+// (make-f64vector n) or (make-f64vector n fill)
+cell makeF64VectorPrimitive(cellSpan c)
+{
+    if (c.empty() || c[0].type != Number || c[0].number < 0) {
+        std::cout << "make-f64vector needs a length\n";
+        return NIL;
+    }
+    // the elements and the count of their bytes must both fit in a size_t
+    if (uint64_t(c[0].number) > (SIZE_MAX - sizeof(f64vectorObject)) / sizeof(double)) {
+        std::cout << "make-f64vector: too long\n";
+        return NIL;
+    }
+    return makeF64Vector(size_t(c[0].number), c.size() > 1 ? toReal(c[1]) : 0);
+}
+
+// (f64vector 1 2.5 3)
+cell f64vectorOf(cellSpan c)
+{
+    cell v = makeF64Vector(c.size(), 0);
+    for (size_t i = 0; i < c.size(); ++i)
+        f64vector(v)->elements[i] = toReal(c[i]);
+    return v;
+}
+
+cell vectorLength(cellSpan c)
+{
+    f64vectorObject* v = vectorArgument(c, 0, "vector-length");
+    return v ? cell(Number, int64_t(v->elements.size())) : NIL;
+}
+
+cell vectorRef(cellSpan c)
+{
+    f64vectorObject* v = vectorArgument(c, 0, "vector-ref");
+    int64_t i = v ? indexArgument(c, 1, v, "vector-ref") : -1;
+    return i < 0 ? NIL : makeReal(v->elements[size_t(i)]);
+}
+
+// stores the value as a double and returns it
+cell vectorSet(cellSpan c)
+{
+    f64vectorObject* v = vectorArgument(c, 0, "vector-set!");
+    int64_t i = v ? indexArgument(c, 1, v, "vector-set!") : -1;
+    if (i < 0 || c.size() < 3 || !isNumber(c[2]))
+        return NIL;
+    v->elements[size_t(i)] = toReal(c[2]);
+    return c[2];
+}
+
+cell vectorSum(cellSpan c)
+{
+    f64vectorObject* v = vectorArgument(c, 0, "vector-sum");
+    return v ? makeReal(sumDoubles(v->elements.data(), v->elements.size())) : NIL;
+}
+
+cell vectorDot(cellSpan c)
+{
+    f64vectorObject* x = vectorArgument(c, 0, "vector-dot");
+    f64vectorObject* y = x ? vectorArgument(c, 1, "vector-dot") : 0;
+    if (!y)
+        return NIL;
+    if (x->elements.size() != y->elements.size()) {
+        std::cout << "vector-dot: lengths differ\n";
+        return NIL;
+    }
+    return makeReal(dotDoubles(x->elements.data(), y->elements.data(), x->elements.size()));
+}
+
+cell vectorMax(cellSpan c)
+{
+    f64vectorObject* v = vectorArgument(c, 0, "vector-max");
+    if (!v || v->elements.empty())
+        return NIL;
+    return makeReal(maxDoubles(v->elements.data(), v->elements.size()));
+}
+
+// a new vector of the elementwise sums of two vectors, or of a vector and
+// a number added to every element
+cell vectorAdd(cellSpan c)
+{
+    f64vectorObject* x = vectorArgument(c, 0, "vector-map+");
+    if (!x || c.size() < 2)
+        return NIL;
+    f64vectorObject* y = f64vector(c[1]);
+    if (y ? y->elements.size() != x->elements.size() : !isNumber(c[1])) {
+        std::cout << "vector-map+ needs two f64vectors of the same length, or an f64vector and a number\n";
+        return NIL;
+    }
+    double scalar = y ? 0 : toReal(c[1]);
+    cell result = makeF64Vector(x->elements.size(), 0);
+    addDoubles(x->elements.data(), y ? y->elements.data() : &scalar, y ? 1 : 0,
+               f64vector(result)->elements.data(), x->elements.size());
+    return result;
+}
+
+////////////////////// hash tables
+
+// Open addressing with linear probing in a power-of-two array of entries,
+// at most three quarters full; removal shifts the rest of a run back so
+// there are no tombstones. Keys match by sameKey: numbers by value within
+// one kind (1 and 1.0 are different keys, Reals compare bit for bit), and
+// symbols, lists and everything else by identity. Symbols, fixnums and
+// other identity keys hash straight from their cell.
+
+// a 64-bit finalizer, so that keys differing in a few low bits still spread
+inline uint64_t mixHash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+uint64_t hashKey(const cell& key)
+{
+    switch (key.type) {
+    case Number:
+        return mixHash(uint64_t(key.number));
+    case Real: {
+        uint64_t bits;
+        memcpy(&bits, &key.real, sizeof(bits));
+        return mixHash(bits);
+    }
+    case Bignum: {
+        uint64_t h = bignum(key)->negative;
+        const digits& magnitude = bignum(key)->magnitude;
+        for (size_t i = 0; i < magnitude.size(); ++i)
+            h = mixHash(h ^ magnitude[i]);
+        return h;
+    }
+    case Rational:
+        return mixHash(hashKey(rational(key)->numerator) ^ (hashKey(rational(key)->denominator) << 1));
+    default:
+        return mixHash(uint64_t(reinterpret_cast<uintptr_t>(key.sym)) ^ uint64_t(key.type));
+    }
+}
+
+bool sameKey(const cell& a, const cell& b)
+{
+    if (a.type != b.type)
+        return false;
+    switch (a.type) {
+    case Number:
+        return a.number == b.number;
+    case Real:
+        return memcmp(&a.real, &b.real, sizeof(double)) == 0;
+    case Bignum:
+    case Rational:
+        return compareNumbers(a, b) == 0;
+    default:
+        return a.sym == b.sym;
+    }
+}
+
+struct hashTableObject : heapObject {
+    struct entry {
+        cell key, value;
+        bool used;
+        entry() : used(false) {}
+    };
+    std::vector<entry> entries; // a power of two of them
+    size_t count;
+
+    hashTableObject() : entries(8), count(0) {}
+
+    void trace()
+    {
+        for (size_t i = 0; i < entries.size(); ++i)
+            if (entries[i].used) {
+                markCell(entries[i].key);
+                markCell(entries[i].value);
+            }
+    }
+
+    size_t mask() const { return entries.size() - 1; }
+
+    // the entry holding key, or the unused one where it would go
+    entry& find(const cell& key)
+    {
+        size_t i = size_t(hashKey(key)) & mask();
+        while (entries[i].used && !sameKey(entries[i].key, key))
+            i = (i + 1) & mask();
+        return entries[i];
+    }
+
+    void set(const cell& key, const cell& value)
+    {
+        if ((count + 1) * 4 > entries.size() * 3)
+            grow();
+        entry& e = find(key);
+        if (!e.used) {
+            e.used = true;
+            e.key = key;
+            ++count;
+        }
+        e.value = value;
+    }
+
+    bool remove(const cell& key)
+    {
+        entry* e = &find(key);
+        if (!e->used)
+            return false;
+        size_t hole = e - entries.data();
+        // move back every later entry of the run that may sit in the hole
+        for (size_t i = (hole + 1) & mask(); entries[i].used; i = (i + 1) & mask()) {
+            size_t home = size_t(hashKey(entries[i].key)) & mask();
+            if (((i - home) & mask()) >= ((i - hole) & mask())) {
+                entries[hole] = entries[i];
+                hole = i;
+            }
+        }
+        entries[hole] = entry();
+        --count;
+        return true;
+    }
+
+    void grow()
+    {
+        std::vector<entry> old(entries.size() * 2);
+        old.swap(entries);
+        count = 0;
+        for (size_t i = 0; i < old.size(); ++i)
+            if (old[i].used)
+                set(old[i].key, old[i].value);
+        retrack(this, sizeof(hashTableObject) + entries.size() * sizeof(entry));
+    }
+};
+
+hashTableObject* hashTable(const cell& c) { return c.type == HashTable ? static_cast<hashTableObject*>(c.object) : 0; }
+
+cell makeHashTable()
+{
+    cell c(HashTable);
+    c.object = track(new hashTableObject, sizeof(hashTableObject) + 8 * sizeof(hashTableObject::entry));
+    return c;
+}
+
+// argument 0 as a hash table with at least n arguments, or 0 after complaining
+hashTableObject* tableArgument(cellSpan c, size_t n, const char* name)
+{
+    hashTableObject* table = c.size() >= n ? hashTable(c[0]) : 0;
+    if (!table)
+        std::cout << name << " needs a hash table\n";
+    return table;
+}
+
+cell makeHashTablePrimitive(cellSpan)
+{
+    return makeHashTable();
+}
+
+// (hash-ref table key) or (hash-ref table key default), () by default
+cell hashRef(cellSpan c)
+{
+    hashTableObject* table = tableArgument(c, 2, "hash-ref");
+    if (!table)
+        return NIL;
+    hashTableObject::entry& e = table->find(c[1]);
+    return e.used ? e.value : c.size() > 2 ? c[2] : NIL;
+}
+
+// returns the value
+cell hashSet(cellSpan c)
+{
+    hashTableObject* table = tableArgument(c, 3, "hash-set!");
+    if (!table)
+        return NIL;
+    table->set(c[1], c[2]);
+    return c[2];
+}
+
+// True if the key was there
+cell hashRemove(cellSpan c)
+{
+    hashTableObject* table = tableArgument(c, 2, "hash-remove!");
+    if (!table)
+        return NIL;
+    return table->remove(c[1]) ? trueSymbol : falseSymbol;
+}
+
+cell hashCount(cellSpan c)
+{
+    hashTableObject* table = tableArgument(c, 1, "hash-count");
+    return table ? cell(Number, int64_t(table->count)) : NIL;
+}
+
+////////////////////// built-in primitive procedures
+
+// Type predicates.
+cell symbolP(cellSpan c) {
+    return c[0].type == Symbol ? trueSymbol : falseSymbol;
+}
+
+cell numberP(cellSpan c) {
+    return isNumber(c[0]) ? trueSymbol : falseSymbol;
+}
+
+cell listP(cellSpan c) {
+    return c[0].type == List ? trueSymbol : falseSymbol;
+}
+
+cell addition(cellSpan c)
+{
+    // adds up all the arguments of the `+` procedure
+    cell n(c[0]);
+    for (const cell* i = c.begin() + 1; i != c.end(); ++i)
+        n = add(n, *i);
+    return n;
+}
+
+cell substraction(cellSpan c)
+{
+    cell n(c[0]);
+    for (const cell* i = c.begin() + 1; i != c.end(); ++i)
+        n = subtract(n, *i);
+    return n;
+}
+
+cell multiplication(cellSpan c)
+{
+    cell n(Number, int64_t(1));
+    for (const cell* i = c.begin(); i != c.end(); ++i)
+        n = multiply(n, *i);
+    return n;
+}
+
+cell division(cellSpan c)
+{
+    cell n(c[0]);
+    for (const cell* i = c.begin() + 1; i != c.end(); ++i)
+        n = divide(n, *i);
+    return n;
+}
+
+// integer division: (quotient 7 2) is 3 and (remainder -7 2) is -1
+cell quotientOrRemainder(cellSpan c, bool wantQuotient)
+{
+    if (!isInteger(c[0]) || !isInteger(c[1])) {
+        std::cout << (wantQuotient ? "quotient" : "remainder") << " needs integers\n";
+        return NIL;
+    }
+    if (isZero(c[1])) {
+        std::cout << "division by zero\n";
+        return NIL;
+    }
+    cell result;
+    divideIntegers(c[0], c[1], wantQuotient ? &result : 0, wantQuotient ? 0 : &result);
+    return result;
+}
+
+cell quotient(cellSpan c) { return quotientOrRemainder(c, true); }
+cell remainder(cellSpan c) { return quotientOrRemainder(c, false); }
+
+cell exactToInexact(cellSpan c) {
+    return isNumber(c[0]) ? makeReal(toReal(c[0])) : c[0];
+}
+
+cell logicOr(cellSpan c) {
+    for (const cell* i = c.begin(); i != c.end(); ++i)
+	if (!isFalse(*i))
+	    return trueSymbol;
+    return falseSymbol;
+}
+
+cell logicAnd(cellSpan c) {
+    for (const cell* i = c.begin(); i != c.end(); ++i)
+	if (isFalse(*i))
+	    return falseSymbol;
+    return trueSymbol;
+}
+
+cell logicNot(cellSpan c) {
+    if (isFalse(c[0]))
+	return trueSymbol;
+    else
+	return falseSymbol;
+}
+
+cell greaterThan(cellSpan c)
+{
+    for (const cell* i = c.begin() + 1; i != c.end(); ++i)
+        if (compareNumbers(c[0], *i) <= 0)
+            return falseSymbol;
+    return trueSymbol;
+}
+
+cell lessThan(cellSpan c)
+{
+    for (const cell* i = c.begin() + 1; i != c.end(); ++i)
+        if (compareNumbers(c[0], *i) >= 0)
+            return falseSymbol;
+    return trueSymbol;
+}
+
+cell lessOrEqualThan(cellSpan c)
+{
+    for (const cell* i = c.begin() + 1; i != c.end(); ++i)
+        if (compareNumbers(c[0], *i) > 0)
+            return falseSymbol;
+    return trueSymbol;
+}
+
+cell greaterOrEqualThan(cellSpan c)
+{
+    for (const cell* i = c.begin() + 1; i != c.end(); ++i)
+        if (compareNumbers(c[0], *i) < 0)
+            return falseSymbol;
+    return trueSymbol;
+}
+
+cell equal(cellSpan c) {
+    // numbers compare by value, everything else by identity
+    if (isNumber(c[0]) || isNumber(c[1]))
+        return isNumber(c[0]) && isNumber(c[1]) && compareNumbers(c[0], c[1]) == 0 ? trueSymbol : falseSymbol;
+    return c[0].type == c[1].type && c[0].sym == c[1].sym ? trueSymbol : falseSymbol;
+}
+
+cell length(cellSpan c) {
+    int64_t n = 0;
+    for (pairObject* p = c[0].pair(); p; p = p->cdr.pair())
+        ++n;
+    return cell(Number, n);
+}
+cell nullPointer(cellSpan c) {
+    return c[0].isNull() ? trueSymbol : falseSymbol;
+}
+// car and cdr of anything but a pair are ()
+cell car(cellSpan c) {
+    pairObject* p = c[0].pair();
+    return p ? p->car : NIL;
+}
+
+cell cdr(cellSpan c)
+{
+    pairObject* p = c[0].pair();
+    return p ? p->cdr : NIL;
+}
+
+// copies the first list only; the result shares the second. Each new pair
+// is linked onto the last, so nothing but the pairs is allocated
+cell append(cellSpan c)
+{
+    cell result(c[1]);
+    cell* tail = &result;
+    for (pairObject* p = c[0].pair(); p; p = p->cdr.pair()) {
+        *tail = cell(List, p->car, c[1]);
+        tail = &tail->pair()->cdr;
+    }
+    return result;
+}
+
+
+cell cons(cellSpan c)
+{
+    return cell(List, c[0], c[1]);
+}
+
+cell list(cellSpan c)
+{
+    return cell(List, c);
+}
+
+std::string toString(const cell& exp);
+
+cell display(cellSpan c)
+{
+    if (c[0].type == Symbol && c[0].sym == newlineSymbol.sym)
+        std::cout << '\n';
+    else if (c[0].type == Symbol && c[0].sym == spaceSymbol.sym)
+        std::cout << ' ';
+    else if (isNumber(c[0]) || c[0].type == F64Vector || c[0].type == HashTable)
+        std::cout << toString(c[0]);
+    else std::cout << c[0].name();
+    return whatTheFuck;
+}
+
+// a (name value) pair for the statistics lists below
+cell stat(const char* name, double value)
+{
+    cells pair;
+    pair.push_back(cell(Symbol, name));
+    pair.push_back(cell(Number, int64_t(value)));
+    return cell(List, pair);
+}
+
+// ((heap-bytes n) (heap-objects n) (collections n) ...), pause times in microseconds
+cell gcStats(cellSpan)
+{
+    cells stats;
+    stats.push_back(stat("heap-bytes", double(heap.heapBytes)));
+    stats.push_back(stat("heap-objects", double(heap.objectCount)));
+    stats.push_back(stat("collections", double(heap.collections)));
+    stats.push_back(stat("freed-bytes", double(heap.freedBytes)));
+    stats.push_back(stat("last-pause-us", heap.lastPause));
+    stats.push_back(stat("max-pause-us", heap.maxPause));
+    stats.push_back(stat("total-pause-us", heap.totalPause));
+    return cell(List, stats);
+}
+
+// collect now; return the number of bytes freed
+cell gcNow(cellSpan)
+{
+    size_t before = heap.heapBytes;
+    collect();
+    return cell(Number, int64_t(before - heap.heapBytes));
+}
+
+cell exitCode(cellSpan)
+{
+    exit(0);
+}
+
+// the parallel primitives, see "parallel evaluation" below
+cell parallelMap(cellSpan c);
+cell parallelForEach(cellSpan c);
+cell parallelReduce(cellSpan c);
+
+// see "memoization" below
+cell memoize(cellSpan c);
+cell memoStats(cellSpan c);
+
+// the built-in procedures under their global names; images refer to them
+// by their position here, so only ever add to the end
+struct primitive {
+    const char* name;
+    cell::procType proc;
+};
+
+const primitive primitives[] = {
+    { "display", &display }, { "exit", &exitCode },
+    { "append", &append }, { "car", &car },
+    { "cdr", &cdr }, { "cons", &cons },
+    { "length", &length }, { "list", &list },
+    { "null?", &nullPointer }, { "+", &addition },
+    { "-", &substraction }, { "*", &multiplication },
+    { "/", &division }, { ">", &greaterThan },
+    { "<", &lessThan }, { "<=", &lessOrEqualThan },
+    { ">=", &greaterOrEqualThan },
+    { "=", &equal }, { "symbol?", &symbolP },
+    { "number?", &numberP }, { "list?", &listP },
+    { "or", &logicOr }, { "and", &logicAnd },
+    { "not", &logicNot },
+    { "gc", &gcNow }, { "gc-stats", &gcStats },
+    { "pmap", &parallelMap }, { "pfor-each", &parallelForEach },
+    { "preduce", &parallelReduce },
+    { "quotient", &quotient }, { "remainder", &remainder },
+    { "exact->inexact", &exactToInexact },
+    { "make-f64vector", &makeF64VectorPrimitive }, { "f64vector", &f64vectorOf },
+    { "vector-length", &vectorLength }, { "vector-ref", &vectorRef }, { "vector-set!", &vectorSet },
+    { "vector-sum", &vectorSum }, { "vector-dot", &vectorDot }, { "vector-max", &vectorMax },
+    { "vector-map+", &vectorAdd },
+    { "make-hash-table", &makeHashTablePrimitive }, { "hash-ref", &hashRef }, { "hash-set!", &hashSet },
+    { "hash-remove!", &hashRemove }, { "hash-count", &hashCount },
+    { "memoize", &memoize }, { "memo-stats", &memoStats }
+};
+
+const size_t primitiveCount = sizeof(primitives) / sizeof(primitives[0]);
+
+// the table entry of a primitive, or 0
+const primitive* findPrimitive(cell::procType proc)
+{
+    for (size_t i = 0; i < primitiveCount; ++i)
+        if (primitives[i].proc == proc)
+            return &primitives[i];
+    return 0;
+}
+
+// define the bare minimum set of primintives necessary to pass the unit tests
+void addGlobals(globalEnvironment& env)
+{
+    env["nil"] = NIL;   env["False"] = falseSymbol;  env["True"] = trueSymbol;
+    env["\\s"] = spaceSymbol; env["\\n"] = newlineSymbol;
+    for (size_t i = 0; i < primitiveCount; ++i)
+        env[primitives[i].name] = cell(primitives[i].proc);
+}
+
+
+////////////////////// profiler
+
+// With --profile, both engines tell the profiler when a lambda or a
+// primitive is entered and left. The calls in progress are kept on a
+// shadow stack, where a tail call replaces its caller's entry just as it
+// replaces the caller's frame. A call's exclusive time and allocations are
+// what remains after its callees' are taken out, and a recursive procedure
+// counts inclusive time once, for its outermost call. Each distinct stack
+// of procedures is a node of a call tree, which gives the folded stacks.
+// Only the main thread profiles; worker threads have no profiler.
+//
+// --sample doesn't go through here: the engines only poll for its timer
+// ticks, see samplePoll.
+
+struct lambdaSource;
+
+struct profiler {
+    // the totals of one lambda or primitive
+    struct procedure {
+        std::shared_ptr<lambdaSource> source; // 0 for a primitive; keeps the key from being reused
+        cell::procType proc;
+        uint64_t calls;
+        uint64_t allocations; // exclusive
+        int64_t inclusive, exclusive; // in nanoseconds
+        size_t active; // calls of it on the stack
+    };
+    // one distinct stack of procedures
+    struct stackNode {
+        size_t procedure; // meaningless for the root, tree[0]
+        size_t parent;
+        std::vector<size_t> children;
+        int64_t exclusive;
+    };
+    // a call in progress
+    struct entry {
+        size_t node;
+        int64_t start, inner; // inner: time spent in callees
+        size_t allocations, innerAllocations;
+    };
+
+    std::vector<procedure> procedures;
+    std::unordered_map<const void*, size_t> indices; // by source or primitive
+    std::vector<stackNode> tree;
+    std::vector<entry> stack;
+    size_t runBase; // entries below this belong to enclosing run() loops
+
+    profiler() : tree(1), runBase(0) {}
+
+    static int64_t now()
+	{
+	    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+    size_t procedureOf(const void* key, const std::shared_ptr<lambdaSource>* source, cell::procType proc)
+	{
+	    std::unordered_map<const void*, size_t>::iterator i = indices.find(key);
+	    if (i != indices.end())
+		return i->second;
+	    procedure p = { source ? *source : std::shared_ptr<lambdaSource>(), proc, 0, 0, 0, 0, 0 };
+	    procedures.push_back(p);
+	    return indices[key] = procedures.size() - 1;
+	}
+
+    void enter(size_t p)
+	{
+	    size_t parent = stack.empty() ? 0 : stack.back().node;
+	    size_t node = 0;
+	    const std::vector<size_t>& children = tree[parent].children;
+	    for (size_t i = 0; i < children.size() && !node; ++i)
+		if (tree[children[i]].procedure == p)
+		    node = children[i];
+	    if (!node) {
+		stackNode n = { p, parent, std::vector<size_t>(), 0 };
+		tree.push_back(n);
+		node = tree.size() - 1;
+		tree[parent].children.push_back(node);
+	    }
+	    ++procedures[p].calls;
+	    ++procedures[p].active;
+	    entry e = { node, now(), 0, allocationCount, 0 };
+	    stack.push_back(e);
+	}
+
+    void leave()
+	{
+	    entry e = stack.back();
+	    stack.pop_back();
+	    int64_t elapsed = now() - e.start;
+	    size_t allocations = allocationCount - e.allocations;
+	    procedure& p = procedures[tree[e.node].procedure];
+	    p.exclusive += elapsed - e.inner;
+	    tree[e.node].exclusive += elapsed - e.inner;
+	    p.allocations += allocations - e.innerAllocations;
+	    if (--p.active == 0)
+		p.inclusive += elapsed;
+	    if (!stack.empty()) {
+		stack.back().inner += elapsed;
+		stack.back().innerAllocations += allocations;
+	    }
+	}
+
+    void enterLambda(const std::shared_ptr<lambdaSource>& source) { enter(procedureOf(source.get(), &source, 0)); }
+    void enterPrimitive(cell::procType proc) { enter(procedureOf(reinterpret_cast<const void*>(proc), 0, proc)); }
+
+    // a lambda called by the innermost run() loop, in place of the call
+    // that loop was running, if any
+    void callLambda(const std::shared_ptr<lambdaSource>& source)
+	{
+	    if (stack.size() > runBase)
+		leave();
+	    enterLambda(source);
+	}
+};
+
+thread_local profiler* activeProfiler = 0;
+
+// Timer ticks of the sampling profiler not yet sampled. The engines poll
+// for them after each primitive returns and before each lambda call
+// switches frames, so every tick is counted for the stack of lambdas that
+// was running when it came, whatever primitive that stack was in.
+std::atomic<unsigned> sampleTicks(0);
+void takeSample(); // see "sampling profiler" below
+
+inline void samplePoll()
+{
+    if (sampleTicks.load(std::memory_order_relaxed))
+        takeSample();
+}
+
+// the calls one run() loop makes, starting with the lambda it was given
+// to run if any: they are left when the loop ends, and a tail call replaces
+// the innermost, as in the virtual machine
+struct profileScope {
+    profiler* active; // read once: the thread-local costs a lookup
+    size_t savedBase;
+    explicit profileScope(const std::shared_ptr<lambdaSource>* called) : active(activeProfiler), savedBase(0)
+	{
+	    if (active) {
+		savedBase = active->runBase;
+		active->runBase = active->stack.size();
+		if (called)
+		    active->enterLambda(*called);
+	    }
+	}
+    ~profileScope()
+	{
+	    if (active) {
+		while (active->stack.size() > active->runBase)
+		    active->leave();
+		active->runBase = savedBase;
+	    }
+	}
+};
+
+
+////////////////////// analysis
+
+// Each form is analyzed once into a tree of nodes that know how to execute
+// themselves, so running a lambda body again (a loop, a recursive call)
+// doesn't look at its syntax again: no keyword compares, no size() checks.
+// Variables are resolved at the same time: a lambda's parameters and
+// internal defines get fixed slots in its frame, so a local reference is a
+// (depth, slot) pair and a global one is a pointer to the symbol's slot.
+
+void loadFile(const std::string& name);
+cell applyMemo(const cell& memo, cellSpan args); // see "memoization" below
+
+// procedures applied so far by either engine, what the benchmarks count as evals
+thread_local uint64_t applicationCount = 0;
+
+struct node {
+    virtual ~node() {}
+    virtual cell execute(environment* env) = 0;
+
+    // Execute this node in tail position: either set `result` and return 0,
+    // or return the node that the caller should execute next in place of
+    // this one (possibly in a new frame `env`). Only nodes with a tail
+    // position (if, begin, calls) override this.
+    virtual node* tail(environment*& env, cell& result)
+    {
+        result = execute(env);
+        return 0;
+    }
+};
+
+typedef std::shared_ptr<node> nodePtr;
+
+// Execute a node and then whatever it hands over to in tail position, in a
+// loop rather than by recursion: an if arm, the last form of a begin or a
+// lambda body reuses this C++ frame, so iterative loops run in O(1) stack.
+// `called` is the lambda whose body this is, when one is applied, for the
+// profiler.
+cell run(node* n, environment* env, const std::shared_ptr<lambdaSource>* called = 0)
+{
+    frameRoot rootEnv(env);
+    frameScope ownFrames;
+    profileScope profiled(called);
+    cell result;
+    while ((n = n->tail(env, result)))
+        ;
+    return result;
+}
+
+// the variables of a lambda being analyzed, chained to the enclosing lambda
+struct scope {
+    std::vector<symbol*> names; // parameters first, then internal defines
+    const scope* outer;
+    mutable bool captured; // a lambda inside may outlive the frame
+    explicit scope(const scope* outer) : outer(outer), captured(false) {}
+
+    // add a variable unless it is already there
+    void add(symbol* name)
+	{
+	    if (slotOf(name) < 0)
+		names.push_back(name);
+	}
+
+    // return the slot of the given variable in this frame, or -1
+    int slotOf(symbol* name) const
+	{
+	    for (size_t i = 0; i < names.size(); ++i)
+		if (names[i] == name)
+		    return int(i);
+	    return -1;
+	}
+};
+
+// where a variable lives: `depth` frames out at `slot`, or global if slot < 0
+struct address {
+    size_t depth;
+    int slot;
+};
+
+address resolve(symbol* name, const scope* sc)
+{
+    address a = { 0, -1 };
+    for (; sc; sc = sc->outer, ++a.depth)
+        if ((a.slot = sc->slotOf(name)) >= 0)
+            return a;
+    return a;
+}
+
+// What a lambda expression was made from, so that images can save a lambda
+// and rebuild its code when they are loaded: re-analyzing the form in
+// scopes with the same names lays out the same frames.
+// where the reader found the (lambda ...) lists of the form being
+// evaluated, "file:line" or "line:col" at the prompt; eval() empties it
+// once the form is analyzed or compiled, before its pairs can be freed
+std::unordered_map<const pairObject*, std::string> lambdaLocations;
+
+struct lambdaSource {
+    rootedCell form; // the whole (lambda ...) expression
+    std::vector<std::vector<symbol*> > scopes; // the enclosing frames' names, innermost first
+    std::string name; // the variable it was defined as, if any, for the profiler
+    std::string location; // where it was read, if known, for the profiler
+
+    lambdaSource(const cell& form, const scope* sc) : form(form)
+	{
+	    for (; sc; sc = sc->outer)
+		scopes.push_back(sc->names);
+	    if (!lambdaLocations.empty()) {
+		std::unordered_map<const pairObject*, std::string>::iterator i = lambdaLocations.find(form.pair());
+		if (i != lambdaLocations.end())
+		    location = i->second;
+	    }
+	}
+};
+
+
+nodePtr analyze(const cell& x, const scope* sc);
+
+// a number, a quoted form or ()
+struct constNode : node {
+    rootedCell constant; // alive as long as the code that quotes it
+    explicit constNode(const cell& value) : constant(value) {}
+    cell execute(environment*) { return constant.value; }
+};
+
+// a reference to a parameter or internal define of this or an enclosing lambda
+struct localNode : node {
+    address where;
+    explicit localNode(address where) : where(where) {}
+    cell execute(environment* env) { return env->up(where.depth)->slots[where.slot]; }
+};
+
+// a reference to a global variable
+struct globalNode : node {
+    symbol* name;
+    explicit globalNode(symbol* name) : name(name) {}
+    cell execute(environment*)
+    {
+        if (isUnbound(name->value))
+            std::cout << "unbound symbol '" << name->name << "'\n";
+        return name->value;
+    }
+};
+
+// (if test conseq [alt])
+struct ifNode : node {
+    nodePtr test, conseq, alt; // alt is null when omitted
+    cell execute(environment* env) { return run(this, env); }
+    node* tail(environment*& env, cell& result)
+    {
+        if (!isFalse(test->execute(env)))
+            return conseq.get();
+        if (alt)
+            return alt.get();
+        result = NIL;
+        return 0;
+    }
+};
+
+// (set! var exp) or (define var exp) of a local variable
+struct setLocalNode : node {
+    address where;
+    nodePtr value;
+    cell execute(environment* env) { return env->up(where.depth)->slots[where.slot] = value->execute(env); }
+};
+
+// (set! var exp) of a global variable
+struct setGlobalNode : node {
+    symbol* name;
+    nodePtr value;
+    cell execute(environment* env)
+    {
+        cell result(value->execute(env));
+        if (isUnbound(name->value))
+            std::cout << "unbound symbol '" << name->name << "'\n";
+        return name->value = result;
+    }
+};
+
+// (define var exp) at top level
+struct defineNode : node {
+    symbol* name;
+    nodePtr value;
+    cell execute(environment* env) { return name->value = value->execute(env); }
+};
+
+// (begin exp*)
+struct beginNode : node {
+    std::vector<nodePtr> body;
+    cell execute(environment* env) { return run(this, env); }
+    node* tail(environment*& env, cell&)
+    {
+        for (size_t i = 0; i < body.size() - 1; ++i)
+            body[i]->execute(env);
+        return body.back().get();
+    }
+};
+
+// (lambda (var*) exp*)
+struct lambdaNode : node, std::enable_shared_from_this<lambdaNode> {
+    size_t arity; // parameters take the first slots of the frame
+    size_t frameSize; // parameters plus internal defines
+    bool captures; // the body has a lambda that may keep the frame alive
+    nodePtr body;
+    std::shared_ptr<lambdaSource> source;
+    cell execute(environment* env)
+    {
+        // keep a reference to the environment that exists now (when the
+        // lambda is being defined) because that's the outer environment
+        // we'll need to use when the lambda is executed
+        return cell(Lambda, shared_from_this(), env);
+    }
+};
+
+// (load file-symbol)
+struct loadNode : node {
+    nodePtr name;
+    cell execute(environment* env)
+    {
+        cell file = name->execute(env);
+        if (file.name() == "nil")
+            return falseSymbol;
+        // a loaded file always defines into the global environment
+        loadFile(file.name());
+        return trueSymbol;
+    }
+};
+
+// (proc exp*)
+struct callNode : node {
+    nodePtr proc;
+    // When proc names a global, the call site reads its binding straight
+    // from the symbol's value slot. The slot is the one place define and
+    // set! store to, so it never goes stale and needs no invalidation.
+    symbol* global;
+    std::vector<nodePtr> args;
+    callNode() : global(0) {}
+    cell execute(environment* env) { return run(this, env); }
+    node* tail(environment*& env, cell& result)
+    {
+        cell function(global && !isUnbound(global->value) ? global->value : proc->execute(env));
+        cellRoot rootFunction(function);
+        size_t argc = args.size();
+        if (!values.has(argc)) {
+            std::cout << "stack overflow\n";
+            result = NIL;
+            return 0;
+        }
+        // the arguments are evaluated in place on the value stack, and
+        // popped again whichever way the call goes
+        cell* exps = values.top;
+        for (size_t i = 0; i < argc; ++i) {
+            cell value = args[i]->execute(env);
+            *values.top++ = value;
+        }
+        ++applicationCount;
+        if (function.type == Lambda) {
+            // Create a frame for the execution of this lambda function whose
+            // outer frame is the one that existed at the time the lambda was
+            // defined, and fill its first slots with the given arguments.
+            lambdaObject* lambda = function.lambda();
+            lambdaNode* code = lambda->code.get();
+            samplePoll(); // while the caller's frame is still the current one
+            // The body is this call's tail: the caller's run() loop executes
+            // it in the new frame instead of recursing.
+            // The frame of the caller's run() loop is dead now that all
+            // arguments are evaluated, so any stacked frames it made go.
+            frames.release();
+            environment* frame = environment::make(code->frameSize, lambda, !code->captures);
+            for (size_t i = 0; i < code->arity && i < argc; ++i)
+                frame->slots[i] = exps[i];
+            values.top = exps;
+            env = frame;
+            if (profiler* active = activeProfiler)
+                active->callLambda(code->source);
+            gcPoll();
+            return code->body.get();
+        }
+        else if (function.type == Proc) {
+            if (profiler* active = activeProfiler) {
+                active->enterPrimitive(function.proc);
+                result = function.proc(cellSpan(exps, argc));
+                active->leave();
+            }
+            else
+                result = function.proc(cellSpan(exps, argc));
+        }
+        else if (function.type == Memo)
+            result = applyMemo(function, cellSpan(exps, argc));
+        else {
+            std::cout << "not a function\n";
+            result = NIL;
+        }
+        samplePoll();
+        values.top = exps;
+        return 0;
+    }
+};
+
+// the i-th element of a special form, or () if the form is too short
+const cell& part(const cells& form, size_t i)
+{
+    static const cell missing(List);
+    return i < form.size() ? form[i] : missing;
+}
+
+// internal defines become slots of the lambda's frame, so find them all
+// up front (without looking inside quoted data or nested lambdas)
+void collectDefines(const cell& x, scope& sc)
+{
+    pairObject* form = x.pair();
+    if (!form)
+        return;
+    if (form->car.type == Symbol) {
+        if (form->car.sym == quoteKeyword || form->car.sym == lambdaKeyword)
+            return;
+        pairObject* rest = form->cdr.pair();
+        if ((form->car.sym == defineKeyword || form->car.sym == defineMemoKeyword) && rest && rest->car.type == Symbol)
+            sc.add(rest->car.sym);
+    }
+    for (pairObject* p = form; p; p = p->cdr.pair())
+        collectDefines(p->car, sc);
+}
+
+// (define-memo var exp [bound]) is (define var (memoize exp [bound])), so
+// the recursive calls in exp find the memoized procedure
+cell expandDefineMemo(const cells& form)
+{
+    cells memoized(1, cell(Symbol, "memoize"));
+    memoized.push_back(part(form, 2));
+    if (form.size() > 3)
+        memoized.push_back(form[3]);
+    cells define(1, cell(Symbol, "define"));
+    define.push_back(part(form, 1));
+    define.push_back(cell(List, memoized));
+    return cell(List, define);
+}
+
+// whether x is (memoize (lambda ...) ...), as define-memo expands to; the
+// lambda then takes the defined name, as a lambda defined directly does
+bool memoizesLambda(const cell& x)
+{
+    static symbol* const memoizeName = intern("memoize");
+    pairObject* call = x.pair();
+    pairObject* rest = call ? call->cdr.pair() : 0;
+    pairObject* lambda = rest ? rest->car.pair() : 0;
+    return call && call->car.type == Symbol && call->car.sym == memoizeName &&
+        lambda && lambda->car.type == Symbol && lambda->car.sym == lambdaKeyword;
+}
+
+// analyze a sequence of forms as one: a single node or a (begin ...)
+nodePtr analyzeBody(const cells& form, size_t first, const scope* sc)
+{
+    if (form.size() == first + 1)
+        return analyze(form[first], sc);
+    std::shared_ptr<beginNode> n(new beginNode);
+    for (size_t i = first; i < form.size(); ++i)
+        n->body.push_back(analyze(form[i], sc));
+    if (n->body.empty())
+        n->body.push_back(nodePtr(new constNode(NIL)));
+    return n;
+}
+
+// turn a read form into an executable node, resolving variables against the
+// scope of the enclosing lambdas (0 at top level)
+nodePtr analyze(const cell& x, const scope* sc)
+{
+    if (x.type == Symbol) {
+        address a = resolve(x.sym, sc);
+        if (a.slot < 0)
+            return nodePtr(new globalNode(x.sym));
+        return nodePtr(new localNode(a));
+    }
+    if (x.type != List || x.isNull())
+        return nodePtr(new constNode(x));
+    const cells form = x.items();
+    if (form[0].type == Symbol) {
+        symbol* keyword = form[0].sym;
+        if (keyword == quoteKeyword)       // (quote exp)
+            return nodePtr(new constNode(part(form, 1)));
+        if (keyword == ifKeyword) {        // (if test conseq [alt])
+            std::shared_ptr<ifNode> n(new ifNode);
+            n->test = analyze(part(form, 1), sc);
+            n->conseq = analyze(part(form, 2), sc);
+            if (form.size() > 3)
+                n->alt = analyze(form[3], sc);
+            return n;
+        }
+        if (keyword == setKeyword || keyword == defineKeyword) { // (set! var exp), (define var exp)
+            if (part(form, 1).type != Symbol) {
+                std::cout << "bad syntax: " << keyword->name << " needs a variable name\n";
+                return nodePtr(new constNode(NIL));
+            }
+            symbol* name = form[1].sym;
+            nodePtr value = analyze(part(form, 2), sc);
+            lambdaNode* lambda = dynamic_cast<lambdaNode*>(value.get());
+            if (callNode* call = dynamic_cast<callNode*>(value.get()))
+                if (memoizesLambda(part(form, 2)))
+                    lambda = dynamic_cast<lambdaNode*>(call->args[0].get());
+            if (lambda)
+                lambda->source->name = name->name;
+            address a = resolve(name, sc);
+            if (a.slot >= 0) {
+                std::shared_ptr<setLocalNode> n(new setLocalNode);
+                n->where = a;
+                n->value = value;
+                return n;
+            }
+            if (keyword == defineKeyword) {
+                std::shared_ptr<defineNode> n(new defineNode);
+                n->name = name;
+                n->value = value;
+                return n;
+            }
+            std::shared_ptr<setGlobalNode> n(new setGlobalNode);
+            n->name = name;
+            n->value = value;
+            return n;
+        }
+        if (keyword == lambdaKeyword) {    // (lambda (var*) exp*)
+            std::shared_ptr<lambdaNode> n(new lambdaNode);
+            if (sc)
+                sc->captured = true;
+            scope inner(sc);
+            const cells parms = part(form, 1).items();
+            for (cellIterator p = parms.begin(); p != parms.end(); ++p)
+                if (p->type == Symbol)
+                    inner.names.push_back(p->sym);
+            n->arity = inner.names.size();
+            for (size_t i = 2; i < form.size(); ++i)
+                collectDefines(form[i], inner);
+            n->frameSize = inner.names.size();
+            n->body = analyzeBody(form, 2, &inner);
+            n->captures = inner.captured;
+            n->source.reset(new lambdaSource(x, sc));
+            return n;
+        }
+        if (keyword == beginKeyword)       // (begin exp*)
+            return analyzeBody(form, 1, sc);
+        if (keyword == defineMemoKeyword)  // (define-memo var exp [bound])
+            return analyze(expandDefineMemo(form), sc);
+        if (keyword == loadKeyword) {      // (load file-symbol)
+            if (form.size() != 2)
+                return nodePtr(new constNode(falseSymbol));
+            std::shared_ptr<loadNode> n(new loadNode);
+            n->name = analyze(form[1], sc);
+            return n;
+        }
+    }
+    std::shared_ptr<callNode> n(new callNode);
+    n->proc = analyze(form[0], sc);
+    if (form[0].type == Symbol && resolve(form[0].sym, sc).slot < 0)
+        n->global = form[0].sym;
+    for (cellIterator exp = form.begin() + 1; exp != form.end(); ++exp)
+        n->args.push_back(analyze(*exp, sc));
+    return n;
+}
+
+
+////////////////////// bytecode compiler and virtual machine
+
+// The alternative engine selected with --vm: every top-level form and lambda
+// is compiled to a flat array of instructions for a stack machine. Variables
+// are resolved with the same scopes as the analysis above and frames are the
+// same environments, so a compiled lambda is an ordinary Lambda cell.
+
+enum opcode {
+    opConst,        // push constants[a]
+    opLocal0,       // push slot a of the current frame
+    opLocal,        // push slot b of the frame a levels out
+    opGlobal,       // push the global value of symbols[a]
+    opSetLocal,     // store the top of the stack in slot b of the frame a levels out
+    opSetGlobal,    // store the top of the stack as the value of symbols[a] (set!)
+    opDefine,       // same, for a top-level define
+    opPop,
+    opJump,         // continue at instruction a
+    opJumpIfFalse,  // pop; continue at instruction a if it was False
+    opCall,         // call the procedure below the a arguments on top of the stack
+    opTailCall,     // same, in place of the current call
+    opReturn,       // pop the result and return it to the caller
+    opClosure,      // push a lambda for children[a] in the current frame
+    opLoad,         // pop a file name and load it
+    // (op x y) where op is a global still bound to the built-in primitive
+    // symbols[a]; otherwise these make an ordinary call
+    opAdd, opSubtract, opLess, opGreater, opLessOrEqual, opGreaterOrEqual, opEqual
+};
+
+struct instruction {
+    opcode op;
+    int a, b;
+};
+
+// the compiled code of a lambda (or of a top-level form)
+struct prototype {
+    std::vector<instruction> code;
+    std::deque<rootedCell> constants; // a deque never moves its elements
+    std::vector<symbol*> symbols; // the globals referenced
+    std::vector<std::shared_ptr<prototype> > children; // lambdas made here
+    size_t arity; // parameters take the first slots of the frame
+    size_t frameSize; // parameters plus internal defines
+    size_t maxStack; // most stack slots used at once
+    bool captures; // has a lambda that may keep the frame alive
+    std::shared_ptr<lambdaSource> source; // 0 for a top-level form
+
+    prototype() : arity(0), frameSize(0), maxStack(0), captures(false) {}
+};
+
+// compiles one prototype, keeping track of how deep the stack gets
+struct compiler {
+    prototype* proto;
+    int depth;
+
+    explicit compiler(prototype* proto) : proto(proto), depth(0) {}
+
+    size_t emit(opcode op, int a = 0, int b = 0)
+	{
+	    static const int effects[] = { 1, 1, 1, 1, 0, 0, 0, -1, 0, -1, 0, 0, -1, 1, 0, -1, -1, -1, -1, -1, -1, -1 };
+	    instruction i = { op, a, b };
+	    proto->code.push_back(i);
+	    if (op == opCall || op == opTailCall)
+		depth -= a;
+	    else
+		depth += effects[op];
+	    proto->maxStack = std::max(proto->maxStack, size_t(depth));
+	    return proto->code.size() - 1;
+	}
+
+    int constant(const cell& value)
+	{
+	    proto->constants.emplace_back(value);
+	    return int(proto->constants.size() - 1);
+	}
+
+    int global(symbol* name)
+	{
+	    for (size_t i = 0; i < proto->symbols.size(); ++i)
+		if (proto->symbols[i] == name)
+		    return int(i);
+	    proto->symbols.push_back(name);
+	    return int(proto->symbols.size() - 1);
+	}
+
+    // point the jump at `from` to the next instruction
+    void patch(size_t from) { proto->code[from].a = int(proto->code.size()); }
+
+    void compile(const cell& x, const scope* sc, bool tail);
+    void compileBody(const cells& form, size_t first, const scope* sc, bool tail);
+    void compileLambda(const cell& x, const cells& form, const scope* sc);
+};
+
+// the primitive behind each of the inlined operators, in opcode order from opAdd
+struct inlinedOperator {
+    const char* name;
+    cell::procType proc;
+    opcode op;
+};
+
+const inlinedOperator inlinedOperators[] = {
+    { "+", &addition, opAdd }, { "-", &substraction, opSubtract },
+    { "<", &lessThan, opLess }, { ">", &greaterThan, opGreater },
+    { "<=", &lessOrEqualThan, opLessOrEqual }, { ">=", &greaterOrEqualThan, opGreaterOrEqual },
+    { "=", &equal, opEqual }
+};
+
+// whether the global still holds the built-in primitive, so an inlined
+// operator may skip the call; the type comes first, as the proc of a
+// rebound variable is just the bits of whatever it holds now
+inline bool stillNames(const symbol* global, cell::procType proc)
+{
+    return global->value.type == Proc && global->value.proc == proc;
+}
+
+void compiler::compile(const cell& x, const scope* sc, bool tail)
+{
+    if (x.type == Symbol) {
+        address a = resolve(x.sym, sc);
+        if (a.slot < 0)
+            emit(opGlobal, global(x.sym));
+        else if (a.depth == 0)
+            emit(opLocal0, a.slot);
+        else
+            emit(opLocal, int(a.depth), a.slot);
+        return;
+    }
+    if (x.type != List || x.isNull()) {
+        emit(opConst, constant(x));
+        return;
+    }
+    const cells form = x.items();
+    if (form[0].type == Symbol) {
+        symbol* keyword = form[0].sym;
+        if (keyword == quoteKeyword) {      // (quote exp)
+            emit(opConst, constant(part(form, 1)));
+            return;
+        }
+        if (keyword == ifKeyword) {         // (if test conseq [alt])
+            compile(part(form, 1), sc, false);
+            size_t toAlt = emit(opJumpIfFalse);
+            compile(part(form, 2), sc, tail);
+            size_t toEnd = emit(opJump);
+            --depth; // only one of the arms runs
+            patch(toAlt);
+            if (form.size() > 3)
+                compile(form[3], sc, tail);
+            else
+                emit(opConst, constant(NIL));
+            patch(toEnd);
+            return;
+        }
+        if (keyword == setKeyword || keyword == defineKeyword) { // (set! var exp), (define var exp)
+            if (part(form, 1).type != Symbol) {
+                std::cout << "bad syntax: " << keyword->name << " needs a variable name\n";
+                emit(opConst, constant(NIL));
+                return;
+            }
+            size_t children = proto->children.size();
+            compile(part(form, 2), sc, false);
+            if (proto->children.size() > children &&
+                (proto->code.back().op == opClosure || memoizesLambda(part(form, 2))))
+                proto->children[children]->source->name = form[1].sym->name;
+            address a = resolve(form[1].sym, sc);
+            if (a.slot >= 0)
+                emit(opSetLocal, int(a.depth), a.slot);
+            else
+                emit(keyword == defineKeyword ? opDefine : opSetGlobal, global(form[1].sym));
+            return;
+        }
+        if (keyword == lambdaKeyword) {     // (lambda (var*) exp*)
+            if (sc)
+                sc->captured = true;
+            compileLambda(x, form, sc);
+            return;
+        }
+        if (keyword == beginKeyword) {      // (begin exp*)
+            compileBody(form, 1, sc, tail);
+            return;
+        }
+        if (keyword == defineMemoKeyword) { // (define-memo var exp [bound])
+            compile(expandDefineMemo(form), sc, tail);
+            return;
+        }
+        if (keyword == loadKeyword) {       // (load file-symbol)
+            if (form.size() != 2)
+                emit(opConst, constant(falseSymbol));
+            else {
+                compile(form[1], sc, false);
+                emit(opLoad);
+            }
+            return;
+        }
+        // (op x y) on a global arithmetic or comparison primitive
+        if (form.size() == 3 && resolve(keyword, sc).slot < 0)
+            for (size_t i = 0; i < sizeof(inlinedOperators) / sizeof(inlinedOperators[0]); ++i)
+                if (keyword->name == inlinedOperators[i].name) {
+                    compile(form[1], sc, false);
+                    compile(form[2], sc, false);
+                    emit(inlinedOperators[i].op, global(keyword));
+                    return;
+                }
+    }
+    // (proc exp*)
+    for (cellIterator exp = form.begin(); exp != form.end(); ++exp)
+        compile(*exp, sc, false);
+    emit(tail ? opTailCall : opCall, int(form.size() - 1));
+}
+
+void compiler::compileBody(const cells& form, size_t first, const scope* sc, bool tail)
+{
+    if (form.size() <= first) {
+        emit(opConst, constant(NIL));
+        return;
+    }
+    for (size_t i = first; i < form.size() - 1; ++i) {
+        compile(form[i], sc, false);
+        emit(opPop);
+    }
+    compile(form.back(), sc, tail);
+}
+
+void compiler::compileLambda(const cell& x, const cells& form, const scope* sc)
+{
+    std::shared_ptr<prototype> child(new prototype);
+    child->source.reset(new lambdaSource(x, sc));
+    scope inner(sc);
+    const cells parms = part(form, 1).items();
+    for (cellIterator p = parms.begin(); p != parms.end(); ++p)
+        if (p->type == Symbol)
+            inner.names.push_back(p->sym);
+    child->arity = inner.names.size();
+    for (size_t i = 2; i < form.size(); ++i)
+        collectDefines(form[i], inner);
+    child->frameSize = inner.names.size();
+    compiler body(child.get());
+    body.compileBody(form, 2, &inner, true);
+    body.emit(opReturn);
+    child->captures = inner.captured;
+    proto->children.push_back(child);
+    emit(opClosure, int(proto->children.size() - 1));
+}
+
+// compile a top-level form into a prototype that runs without a frame
+std::shared_ptr<prototype> compileTopLevel(const cell& x)
+{
+    std::shared_ptr<prototype> proto(new prototype);
+    compiler top(proto.get());
+    top.compile(x, 0, true);
+    top.emit(opReturn);
+    return proto;
+}
+
+// one running prototype
+struct activation {
+    prototype* proto;
+    environment* env; // 0 at top level
+    cell* base; // the caller's stack top, below the callee and its arguments
+    size_t frameMark; // frames.top before this call's frame was made
+    const instruction* returnTo; // where the caller continues
+    bool profiled; // a lambda call with an entry on the profiler's stack
+};
+
+// runs on the value stack, whose top it only brings up to date when it
+// calls out or may collect
+struct virtualMachine {
+    std::vector<activation> calls;
+
+    cell run(prototype* entry);
+    cell apply(const cell& function, cellSpan args);
+};
+
+thread_local virtualMachine machine;
+
+void markMachineRoots()
+{
+    for (size_t i = 0; i < machine.calls.size(); ++i) {
+        environment* frame = machine.calls[i].env;
+        if (frame && frame->stacked)
+            frame->trace();
+        else
+            markObject(frame);
+    }
+}
+
+#if defined(__GNUC__)
+// jump straight from one instruction's code to the next one's
+#define VM_COMPUTED_GOTO 1
+#endif
+
+#if VM_COMPUTED_GOTO
+#define VM_CASE(name) label_##name:
+#define VM_NEXT goto *labels[pc->op]
+#else
+#define VM_CASE(name) case name:
+#define VM_NEXT goto dispatch
+#endif
+
+// run a compiled top-level form to completion; re-entrant through load
+cell virtualMachine::run(prototype* entry)
+{
+#if VM_COMPUTED_GOTO
+    static void* labels[] = {
+        &&label_opConst, &&label_opLocal0, &&label_opLocal, &&label_opGlobal,
+        &&label_opSetLocal, &&label_opSetGlobal, &&label_opDefine, &&label_opPop,
+        &&label_opJump, &&label_opJumpIfFalse, &&label_opCall, &&label_opTailCall,
+        &&label_opReturn, &&label_opClosure, &&label_opLoad,
+        &&label_opAdd, &&label_opSubtract, &&label_opLess, &&label_opGreater,
+        &&label_opLessOrEqual, &&label_opGreaterOrEqual, &&label_opEqual
+    };
+#endif
+    profiler* const active = activeProfiler; // read once: the thread-local costs a lookup
+    const size_t first = calls.size();
+    activation start = { entry, 0, values.top, frames.top, 0, false };
+    calls.push_back(start);
+
+    prototype* proto = entry;
+    environment* env = 0;
+    const instruction* pc = &entry->code[0];
+    cell* sp = values.top;
+    size_t argc = 0;
+    bool tail = false;
+
+    VM_NEXT;
+#if !VM_COMPUTED_GOTO
+dispatch:
+    switch (pc->op) {
+#endif
+    VM_CASE(opConst)
+        *sp++ = proto->constants[pc->a].value;
+        ++pc;
+        VM_NEXT;
+    VM_CASE(opLocal0)
+        *sp++ = env->slots[pc->a];
+        ++pc;
+        VM_NEXT;
+    VM_CASE(opLocal)
+        *sp++ = env->up(pc->a)->slots[pc->b];
+        ++pc;
+        VM_NEXT;
+    VM_CASE(opGlobal) {
+        symbol* name = proto->symbols[pc->a];
+        if (isUnbound(name->value))
+            std::cout << "unbound symbol '" << name->name << "'\n";
+        *sp++ = name->value;
+        ++pc;
+        VM_NEXT;
+    }
+    VM_CASE(opSetLocal)
+        env->up(pc->a)->slots[pc->b] = sp[-1];
+        ++pc;
+        VM_NEXT;
+    VM_CASE(opSetGlobal) {
+        symbol* name = proto->symbols[pc->a];
+        if (isUnbound(name->value))
+            std::cout << "unbound symbol '" << name->name << "'\n";
+        name->value = sp[-1];
+        ++pc;
+        VM_NEXT;
+    }
+    VM_CASE(opDefine)
+        proto->symbols[pc->a]->value = sp[-1];
+        ++pc;
+        VM_NEXT;
+    VM_CASE(opPop)
+        --sp;
+        ++pc;
+        VM_NEXT;
+    VM_CASE(opJump)
+        pc = &proto->code[pc->a];
+        VM_NEXT;
+    VM_CASE(opJumpIfFalse)
+        pc = isFalse(*--sp) ? &proto->code[pc->a] : pc + 1;
+        VM_NEXT;
+    VM_CASE(opCall)
+        argc = pc->a;
+        tail = false;
+        goto call;
+    VM_CASE(opTailCall)
+        argc = pc->a;
+        tail = true;
+        goto call;
+    VM_CASE(opReturn) {
+        cell result = *--sp;
+        activation& done = calls.back();
+        if (done.profiled)
+            active->leave();
+        frames.top = done.frameMark;
+        sp = done.base;
+        pc = done.returnTo;
+        calls.pop_back();
+        if (calls.size() == first) {
+            values.top = sp;
+            return result;
+        }
+        proto = calls.back().proto;
+        env = calls.back().env;
+        *sp++ = result;
+        VM_NEXT;
+    }
+    VM_CASE(opClosure)
+        *sp++ = cell(Lambda, proto->children[pc->a], env);
+        ++pc;
+        VM_NEXT;
+    VM_CASE(opLoad) {
+        cell file = *--sp;
+        values.top = sp;
+        if (file.name() == "nil")
+            *sp++ = falseSymbol;
+        else {
+            loadFile(file.name());
+            *sp++ = trueSymbol;
+        }
+        ++pc;
+        VM_NEXT;
+    }
+    VM_CASE(opAdd)
+        if (!active && stillNames(proto->symbols[pc->a], &addition) && sp[-2].type == Number && sp[-1].type == Number) {
+            int64_t r;
+            if (!addOverflows(sp[-2].number, sp[-1].number, r)) {
+                sp[-2] = cell(Number, r);
+                --sp;
+                ++pc;
+                VM_NEXT;
+            }
+        }
+        goto slowOperator;
+    VM_CASE(opSubtract)
+        if (!active && stillNames(proto->symbols[pc->a], &substraction) && sp[-2].type == Number && sp[-1].type == Number) {
+            int64_t r;
+            if (!subtractOverflows(sp[-2].number, sp[-1].number, r)) {
+                sp[-2] = cell(Number, r);
+                --sp;
+                ++pc;
+                VM_NEXT;
+            }
+        }
+        goto slowOperator;
+    VM_CASE(opLess)
+        if (!active && stillNames(proto->symbols[pc->a], &lessThan) && sp[-2].type == Number && sp[-1].type == Number) {
+            sp[-2] = sp[-2].number < sp[-1].number ? trueSymbol : falseSymbol;
+            --sp;
+            ++pc;
+            VM_NEXT;
+        }
+        goto slowOperator;
+    VM_CASE(opGreater)
+        if (!active && stillNames(proto->symbols[pc->a], &greaterThan) && sp[-2].type == Number && sp[-1].type == Number) {
+            sp[-2] = sp[-2].number > sp[-1].number ? trueSymbol : falseSymbol;
+            --sp;
+            ++pc;
+            VM_NEXT;
+        }
+        goto slowOperator;
+    VM_CASE(opLessOrEqual)
+        if (!active && stillNames(proto->symbols[pc->a], &lessOrEqualThan) && sp[-2].type == Number && sp[-1].type == Number) {
+            sp[-2] = sp[-2].number <= sp[-1].number ? trueSymbol : falseSymbol;
+            --sp;
+            ++pc;
+            VM_NEXT;
+        }
+        goto slowOperator;
+    VM_CASE(opGreaterOrEqual)
+        if (!active && stillNames(proto->symbols[pc->a], &greaterOrEqualThan) && sp[-2].type == Number && sp[-1].type == Number) {
+            sp[-2] = sp[-2].number >= sp[-1].number ? trueSymbol : falseSymbol;
+            --sp;
+            ++pc;
+            VM_NEXT;
+        }
+        goto slowOperator;
+    VM_CASE(opEqual)
+        if (!active && stillNames(proto->symbols[pc->a], &equal) && sp[-2].type == Number && sp[-1].type == Number) {
+            sp[-2] = sp[-2].number == sp[-1].number ? trueSymbol : falseSymbol;
+            --sp;
+            ++pc;
+            VM_NEXT;
+        }
+        goto slowOperator;
+#if !VM_COMPUTED_GOTO
+    }
+#endif
+
+slowOperator:
+    // the operator was rebound or the operands aren't numbers: slide the
+    // procedure in under the two operands and make an ordinary call
+    sp[0] = sp[-1];
+    sp[-1] = sp[-2];
+    sp[-2] = proto->symbols[pc->a]->value;
+    ++sp;
+    argc = 2;
+    tail = false;
+
+call: {
+        cell* args = sp - argc;
+        cell function = args[-1];
+        ++applicationCount;
+        if (function.type == Proc) {
+            values.top = sp;
+            if (active)
+                active->enterPrimitive(function.proc);
+            cell result = function.proc(cellSpan(args, argc));
+            if (active)
+                active->leave();
+            samplePoll();
+            sp = args - 1;
+            *sp++ = result;
+            ++pc;
+            VM_NEXT;
+        }
+        if (function.type == Memo) {
+            values.top = sp;
+            cell result = applyMemo(function, cellSpan(args, argc));
+            samplePoll();
+            sp = args - 1;
+            *sp++ = result;
+            ++pc;
+            VM_NEXT;
+        }
+        if (function.type != Lambda || !function.lambda()->compiled) {
+            std::cout << "not a function\n";
+            sp = args - 1;
+            *sp++ = NIL;
+            ++pc;
+            VM_NEXT;
+        }
+        lambdaObject* lambda = function.lambda();
+        prototype* callee = lambda->compiled.get();
+        samplePoll(); // before the callee takes over or goes on top
+        if (sp + callee->maxStack + 1 >= values.base + valueStack::size) {
+            std::cout << "stack overflow\n";
+            for (size_t i = first; i < calls.size(); ++i)
+                if (calls[i].profiled)
+                    active->leave();
+            frames.top = calls[first].frameMark;
+            values.top = calls[first].base;
+            calls.resize(first);
+            return NIL;
+        }
+        if (tail) {
+            // the current call is finished: its frame (and any stacked frames
+            // above it) go, and the callee takes over its activation
+            activation& current = calls.back();
+            frames.top = current.frameMark;
+            environment* frame = environment::make(callee->frameSize, lambda, !callee->captures);
+            for (size_t i = 0; i < callee->arity && i < argc; ++i)
+                frame->slots[i] = args[i];
+            sp = current.base;
+            current.proto = callee;
+            current.env = frame;
+            if (active) {
+                if (current.profiled)
+                    active->leave();
+                active->enterLambda(callee->source);
+                current.profiled = true;
+            }
+        }
+        else {
+            size_t mark = frames.top;
+            environment* frame = environment::make(callee->frameSize, lambda, !callee->captures);
+            for (size_t i = 0; i < callee->arity && i < argc; ++i)
+                frame->slots[i] = args[i];
+            sp = args - 1;
+            activation next = { callee, frame, sp, mark, pc + 1, active != 0 };
+            calls.push_back(next);
+            if (active)
+                active->enterLambda(callee->source);
+        }
+        proto = callee;
+        env = calls.back().env;
+        pc = &callee->code[0];
+        values.top = sp;
+        gcPoll();
+        VM_NEXT;
+    }
+}
+
+#undef VM_CASE
+#undef VM_NEXT
+
+// call a procedure from C++: it goes on the stack with its arguments, above
+// whatever is running, and a two-instruction entry calls it
+cell virtualMachine::apply(const cell& function, cellSpan args)
+{
+    static thread_local std::vector<std::unique_ptr<prototype> > entries; // by argument count
+    size_t argc = args.size();
+    while (entries.size() <= argc) {
+        prototype* entry = new prototype;
+        compiler emitter(entry);
+        emitter.emit(opTailCall, int(entries.size()));
+        emitter.emit(opReturn);
+        entries.push_back(std::unique_ptr<prototype>(entry));
+    }
+    if (values.top + argc + 1 >= values.base + valueStack::size) {
+        std::cout << "stack overflow\n";
+        return NIL;
+    }
+    cell* saved = values.top;
+    *values.top++ = function;
+    for (size_t i = 0; i < argc; ++i)
+        *values.top++ = args[i];
+    cell result = run(entries[argc].get());
+    values.top = saved;
+    return result;
+}
+
+// run top-level forms on the virtual machine instead of the analyzed nodes
+bool useVirtualMachine = false;
+
+
+////////////////////// parallel evaluation
+
+// apply a procedure to arguments from C++, for the primitives that take procedures
+cell applyProcedure(const cell& function, cellSpan args)
+{
+    if (function.type == Proc && activeProfiler) {
+        activeProfiler->enterPrimitive(function.proc);
+        cell result = function.proc(args);
+        activeProfiler->leave();
+        return result;
+    }
+    if (function.type == Proc)
+        return function.proc(args);
+    if (function.type == Memo)
+        return applyMemo(function, args);
+    if (function.type != Lambda) {
+        std::cout << "not a function\n";
+        return NIL;
+    }
+    lambdaObject* lambda = function.lambda();
+    if (!lambda->code)
+        return machine.apply(function, args);
+    lambdaNode* code = lambda->code.get();
+    frameScope ownFrames;
+    environment* frame = environment::make(code->frameSize, lambda, !code->captures);
+    for (size_t i = 0; i < code->arity && i < args.size(); ++i)
+        frame->slots[i] = args[i];
+    ++applicationCount;
+    return run(code->body.get(), frame, &code->source);
+}
+
+// A work-stealing pool with a worker thread per core besides the calling
+// thread. parallelFor cuts its iterations into chunks and deals them out to
+// one queue per thread; every thread takes chunks from the back of its own
+// queue and, once that is empty, steals from the front of the others'.
+//
+// Only procedures without side effects on shared state should run in
+// parallel: workers read globals and frames freely but nothing orders their
+// writes. Each thread has its own frame stack, VM stack, root stacks and
+// local heap, and collection waits until the workers are done.
+struct workerPool {
+    struct taskQueue {
+        std::mutex lock;
+        std::deque<std::pair<size_t, size_t> > chunks; // [begin, end) of iterations
+    };
+
+    std::vector<std::unique_ptr<taskQueue> > queues; // the calling thread's is the last
+    std::vector<std::unique_ptr<localHeap> > heaps; // one per worker
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    const std::function<void(size_t)>* body; // the iteration of the running parallelFor
+    size_t batch; // counts parallelFor calls, so workers see a new one
+    size_t busy; // workers not yet finished with the current batch
+    bool stopping;
+    // what the workers counted during the current batch, for the calling thread
+    size_t allocations, allocated;
+    uint64_t applications;
+
+    explicit workerPool(size_t threads)
+        : body(0), batch(0), busy(0), stopping(false), allocations(0), allocated(0), applications(0)
+	{
+	    for (size_t i = 0; i <= threads; ++i)
+		queues.push_back(std::unique_ptr<taskQueue>(new taskQueue));
+	    for (size_t i = 0; i < threads; ++i)
+		heaps.push_back(std::unique_ptr<localHeap>(new localHeap));
+	    for (size_t i = 0; i < threads; ++i)
+		workers.push_back(std::thread(&workerPool::work, this, i));
+	}
+
+    ~workerPool()
+	{
+	    {
+		std::lock_guard<std::mutex> hold(lock);
+		stopping = true;
+	    }
+	    wake.notify_all();
+	    for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	}
+
+    // a worker thread: wait for a batch, help run it, repeat
+    void work(size_t self)
+	{
+	    nursery = heaps[self].get();
+#ifndef _WIN32
+	    // the sampling profiler's timer signal is for the main thread
+	    sigset_t profiling;
+	    sigemptyset(&profiling);
+	    sigaddset(&profiling, SIGPROF);
+	    pthread_sigmask(SIG_BLOCK, &profiling, 0);
+#endif
+	    size_t seen = 0;
+	    for (;;) {
+		const std::function<void(size_t)>* f;
+		{
+		    std::unique_lock<std::mutex> hold(lock);
+		    wake.wait(hold, [&] { return stopping || batch != seen; });
+		    if (stopping)
+			return;
+		    seen = batch;
+		    f = body;
+		}
+		size_t ownAllocations = allocationCount, ownAllocated = allocatedBytes;
+		uint64_t ownApplications = applicationCount;
+		runChunks(self, *f);
+		std::lock_guard<std::mutex> hold(lock);
+		allocations += allocationCount - ownAllocations;
+		allocated += allocatedBytes - ownAllocated;
+		applications += applicationCount - ownApplications;
+		if (--busy == 0)
+		    done.notify_all();
+	    }
+	}
+
+    // take a chunk from our own queue, or steal one; false when all are gone
+    bool take(size_t self, std::pair<size_t, size_t>& chunk)
+	{
+	    for (size_t i = 0; i < queues.size(); ++i) {
+		taskQueue& q = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> hold(q.lock);
+		if (q.chunks.empty())
+		    continue;
+		if (i == 0) {
+		    chunk = q.chunks.back();
+		    q.chunks.pop_back();
+		}
+		else {
+		    chunk = q.chunks.front();
+		    q.chunks.pop_front();
+		}
+		return true;
+	    }
+	    return false;
+	}
+
+    void runChunks(size_t self, const std::function<void(size_t)>& f)
+	{
+	    std::pair<size_t, size_t> chunk;
+	    while (take(self, chunk))
+		for (size_t i = chunk.first; i < chunk.second; ++i)
+		    f(i);
+	}
+
+    // run f(0) ... f(n - 1) on all threads and return when every one is done
+    void parallelFor(size_t n, const std::function<void(size_t)>& f)
+	{
+	    size_t chunkSize = std::max<size_t>(1, n / (queues.size() * 4));
+	    for (size_t begin = 0, q = 0; begin < n; begin += chunkSize, q = (q + 1) % queues.size())
+		queues[q]->chunks.push_back(std::make_pair(begin, std::min(n, begin + chunkSize)));
+	    heap.inhibited = true;
+	    {
+		std::lock_guard<std::mutex> hold(lock);
+		body = &f;
+		busy = workers.size();
+		++batch;
+	    }
+	    wake.notify_all();
+	    runChunks(queues.size() - 1, f);
+	    {
+		std::unique_lock<std::mutex> hold(lock);
+		done.wait(hold, [&] { return busy == 0; });
+		body = 0;
+		allocationCount += allocations;
+		allocatedBytes += allocated;
+		applicationCount += applications;
+		allocations = allocated = applications = 0;
+	    }
+	    heap.inhibited = false;
+	    // what the workers allocated joins the rest of the heap
+	    for (size_t i = 0; i < heaps.size(); ++i) {
+		localHeap& h = *heaps[i];
+		if (!h.objects)
+		    continue;
+		h.last->next = heap.objects;
+		heap.objects = h.objects;
+		heap.objectCount += h.objectCount;
+		heap.heapBytes += h.heapBytes;
+		heap.allocatedSinceCollection += h.heapBytes;
+		h = localHeap();
+	    }
+	}
+};
+
+thread_local bool inParallel = false; // running inside a parallelFor already
+
+// run f(0) ... f(n - 1), in parallel unless this already is a parallel
+// section (or there is only one core). Run in turn on the main thread, f
+// may collect, so callers root whatever f's results are kept in.
+void parallelFor(size_t n, const std::function<void(size_t)>& f)
+{
+    static workerPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    if (inParallel || pool.workers.empty() || n < 2) {
+        for (size_t i = 0; i < n; ++i)
+            f(i);
+        return;
+    }
+    inParallel = true;
+    pool.parallelFor(n, [&](size_t i) {
+        inParallel = true; // for the workers, whose flag is their own
+        f(i);
+    });
+    inParallel = false;
+}
+
+// (pmap f list): (f item) for every item, computed in parallel
+cell parallelMap(cellSpan c)
+{
+    cells items(c[1].items());
+    cellsRoot rootItems(items);
+    cells results(items.size());
+    cellsRoot rootResults(results);
+    parallelFor(items.size(), [&](size_t i) {
+        results[i] = applyProcedure(c[0], cellSpan(&items[i], 1));
+    });
+    return cell(List, results);
+}
+
+// (pfor-each f list): (f item) for every item in parallel, for the side
+// effects that are safe to run that way (such as displaying)
+cell parallelForEach(cellSpan c)
+{
+    cells items(c[1].items());
+    cellsRoot rootItems(items);
+    parallelFor(items.size(), [&](size_t i) {
+        applyProcedure(c[0], cellSpan(&items[i], 1));
+    });
+    return NIL;
+}
+
+// (preduce f init list): f folded over init and the items, which runs in
+// parallel chunks, so f must be associative
+cell parallelReduce(cellSpan c)
+{
+    cells items(c[2].items());
+    cellsRoot rootItems(items);
+    size_t chunks = std::min<size_t>(items.size(), std::max(1u, std::thread::hardware_concurrency()) * 4);
+    cells partial(chunks);
+    cellsRoot rootPartial(partial);
+    parallelFor(chunks, [&](size_t k) {
+        size_t begin = items.size() * k / chunks, end = items.size() * (k + 1) / chunks;
+        cell acc(items[begin]);
+        cellRoot rootAcc(acc);
+        cells args(2);
+        cellsRoot rootArgs(args);
+        for (size_t i = begin + 1; i < end; ++i) {
+            args[0] = acc;
+            args[1] = items[i];
+            acc = applyProcedure(c[0], args);
+        }
+        partial[k] = acc;
+    });
+    cell result(c[1]);
+    cellRoot rootResult(result);
+    cells args(2);
+    cellsRoot rootArgs(args);
+    for (size_t k = 0; k < chunks; ++k) {
+        args[0] = result;
+        args[1] = partial[k];
+        result = applyProcedure(c[0], args);
+    }
+    return result;
+}
+
+
+////////////////////// memoization
+
+// (memoize f [bound]) wraps a procedure in a cache of its results, keyed
+// on the arguments compared structurally: numbers by value, lists element
+// by element and everything else by identity, as hash tables compare keys.
+// At most `bound` results are kept; past that the least recently used one
+// goes. Only pure procedures should be memoized, since a hit doesn't call f.
+
+const size_t defaultMemoBound = 1 << 16;
+
+uint64_t structuralHash(const cell& c)
+{
+    if (c.type != List)
+        return hashKey(c);
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    cell rest(c);
+    for (; rest.pair(); rest = rest.pair()->cdr)
+        h = mixHash(h ^ structuralHash(rest.pair()->car));
+    return mixHash(h ^ hashKey(rest));
+}
+
+bool structurallyEqual(const cell& a, const cell& b)
+{
+    if (a.type != List || b.type != List)
+        return sameKey(a, b);
+    pairObject* p = a.pair();
+    pairObject* q = b.pair();
+    for (; p && q; p = p->cdr.pair(), q = q->cdr.pair())
+        if (!structurallyEqual(p->car, q->car))
+            return false;
+    return !p && !q;
+}
+
+struct memoObject : heapObject {
+    struct entry {
+        uint64_t hash;
+        cells args;
+        cell result;
+    };
+    typedef std::list<entry>::iterator position;
+
+    cell function;
+    size_t bound;
+    std::list<entry> recent; // most recently used first
+    std::unordered_multimap<uint64_t, position> index; // by hash of the arguments
+    uint64_t hits, misses;
+    size_t argumentCount; // over all entries
+    std::mutex lock; // pmap may call it from several threads; not held during calls
+
+    memoObject(const cell& function, size_t bound) : function(function), bound(bound), hits(0), misses(0), argumentCount(0) {}
+
+    // what the cache holds on the heap, for the collector: per entry a list
+    // node (the entry and two links), its arguments and an index node (the
+    // key, the position and a link), plus the index's buckets
+    size_t footprint() const
+    {
+        size_t listNode = sizeof(entry) + 2 * sizeof(void*);
+        size_t indexNode = sizeof(std::pair<const uint64_t, position>) + sizeof(void*);
+        return sizeof(memoObject) + recent.size() * (listNode + indexNode) +
+            argumentCount * sizeof(cell) + index.bucket_count() * sizeof(void*);
+    }
+
+    void trace()
+    {
+        markCell(function);
+        for (position i = recent.begin(); i != recent.end(); ++i) {
+            for (size_t a = 0; a < i->args.size(); ++a)
+                markCell(i->args[a]);
+            markCell(i->result);
+        }
+    }
+
+    static uint64_t hashOf(cellSpan args)
+    {
+        uint64_t h = args.size();
+        for (size_t i = 0; i < args.size(); ++i)
+            h = mixHash(h ^ structuralHash(args[i]));
+        return h;
+    }
+
+    // the cached result for these arguments, or 0
+    const cell* find(uint64_t hash, cellSpan args)
+    {
+        typedef std::unordered_multimap<uint64_t, position>::iterator match;
+        std::pair<match, match> range = index.equal_range(hash);
+        for (match m = range.first; m != range.second; ++m) {
+            const cells& cached = m->second->args;
+            bool same = cached.size() == args.size();
+            for (size_t i = 0; same && i < args.size(); ++i)
+                same = structurallyEqual(cached[i], args[i]);
+            if (same) {
+                recent.splice(recent.begin(), recent, m->second);
+                return &m->second->result;
+            }
+        }
+        return 0;
+    }
+
+    void add(uint64_t hash, cellSpan args, const cell& result)
+    {
+        entry e = { hash, cells(args.begin(), args.end()), result };
+        recent.push_front(std::move(e));
+        index.insert(std::make_pair(hash, recent.begin()));
+        argumentCount += args.size();
+        while (recent.size() > bound) {
+            position last = --recent.end();
+            typedef std::unordered_multimap<uint64_t, position>::iterator match;
+            std::pair<match, match> range = index.equal_range(last->hash);
+            for (match m = range.first; m != range.second; ++m)
+                if (m->second == last) {
+                    index.erase(m);
+                    break;
+                }
+            argumentCount -= last->args.size();
+            recent.pop_back();
+        }
+    }
+};
+
+memoObject* memo(const cell& c) { return c.type == Memo ? static_cast<memoObject*>(c.object) : 0; }
+
+cell makeMemo(const cell& function, size_t bound)
+{
+    cell c(Memo);
+    c.object = track(new memoObject(function, bound));
+    return c;
+}
+
+cell applyMemo(const cell& m, cellSpan args)
+{
+    memoObject* cache = memo(m);
+    uint64_t hash = memoObject::hashOf(args);
+    {
+        std::lock_guard<std::mutex> hold(cache->lock);
+        if (const cell* cached = cache->find(hash, args)) {
+            ++cache->hits;
+            return *cached;
+        }
+        ++cache->misses;
+    }
+    cell result = applyProcedure(cache->function, args);
+    std::lock_guard<std::mutex> hold(cache->lock);
+    // the call may have filled the cache with these arguments itself
+    if (!cache->find(hash, args))
+        cache->add(hash, args, result);
+    retrack(cache, cache->footprint());
+    return result;
+}
+
+// (memoize f) or (memoize f bound)
+cell memoize(cellSpan c)
+{
+    if (c.empty() || (c[0].type != Lambda && c[0].type != Proc && c[0].type != Memo)) {
+        std::cout << "memoize needs a procedure\n";
+        return NIL;
+    }
+    size_t bound = defaultMemoBound;
+    if (c.size() > 1) {
+        if (c[1].type != Number || c[1].number < 1) {
+            std::cout << "memoize needs a positive bound\n";
+            return NIL;
+        }
+        bound = size_t(c[1].number);
+    }
+    return makeMemo(c[0], bound);
+}
+
+// ((hits n) (misses n) (size n) (bound n)) of a memoized procedure
+cell memoStats(cellSpan c)
+{
+    memoObject* cache = c.empty() ? 0 : memo(c[0]);
+    if (!cache) {
+        std::cout << "memo-stats needs a memoized procedure\n";
+        return NIL;
+    }
+    cells stats;
+    stats.push_back(stat("hits", double(cache->hits)));
+    stats.push_back(stat("misses", double(cache->misses)));
+    stats.push_back(stat("size", double(cache->recent.size())));
+    stats.push_back(stat("bound", double(cache->bound)));
+    return cell(List, stats);
+}
+
+
+////////////////////// eval
+
+// analyze a top-level form, then run it in the global environment
+cell eval(const cell& x)
+{
+    if (useVirtualMachine) {
+        std::shared_ptr<prototype> compiled = compileTopLevel(x);
+        lambdaLocations.clear();
+        gcPoll();
+        return machine.run(compiled.get());
+    }
+    nodePtr code = analyze(x, 0);
+    lambdaLocations.clear();
+    // the form itself isn't needed any more, so this is a safe point
+    gcPoll();
+    return code->execute(0);
+}
+
+
+////////////////////// parse, read and user interaction
+
+// whitespace predicate
+bool whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' ? 1 : 0; }
+
+// an integer literal, or Symbol if the text isn't one as a whole
+cell integerLiteral(std::string_view token)
+{
+    int64_t n = 0;
+    std::from_chars_result parsed = std::from_chars(token.data(), token.data() + token.size(), n);
+    if (parsed.ptr != token.data() + token.size())
+        return cell(Symbol);
+    if (parsed.ec == std::errc::result_out_of_range)
+        return parseInteger(token);
+    return parsed.ec == std::errc() ? cell(Number, n) : cell(Symbol);
+}
+
+// numbers become Numbers (or Bignums, Rationals like 1/3 and Reals like
+// 2.5 or 1e-3); every other token is a Symbol
+cell atom(std::string_view token)
+{
+    // the literal is parsed here, once, so primitives never see its text
+    size_t first = token[0] == '-' ? 1 : 0;
+    bool numeric = first < token.size() && (isDigit(token[first]) ||
+        (token[first] == '.' && first + 1 < token.size() && isDigit(token[first + 1])));
+    if (numeric) {
+        size_t slash = token.find('/');
+        if (slash != std::string_view::npos) {
+            cell n = integerLiteral(token.substr(0, slash));
+            std::string_view rest = token.substr(slash + 1);
+            bool digitsOnly = !rest.empty() && std::all_of(rest.begin(), rest.end(), isDigit);
+            cell d = digitsOnly ? integerLiteral(rest) : cell(Symbol);
+            if (isInteger(n) && isInteger(d) && !isZero(d))
+                return makeRational(n, d);
+        }
+        else if (token.find_first_of(".eE") != std::string_view::npos) {
+            double d = 0;
+            std::from_chars_result parsed = std::from_chars(token.data(), token.data() + token.size(), d);
+            // too large or too small for a double: strtod gives +-inf or 0
+            if (parsed.ec == std::errc::result_out_of_range)
+                d = std::strtod(std::string(token).c_str(), 0);
+            if (parsed.ptr == token.data() + token.size() && parsed.ec != std::errc::invalid_argument)
+                return makeReal(d);
+        }
+        else {
+            cell n = integerLiteral(token);
+            if (n.type != Symbol)
+                return n;
+        }
+    }
+    return cell(Symbol, token);
+}
+
+// what reading a top-level form came to
+enum readResult { readForm, readEnd, readError };
+
+// A recursive-descent reader: characters go straight from a buffer or a
+// stream into cells, one form at a time, so a file is evaluated while it
+// is being read and never has to be held in memory as a whole. After a
+// syntax error it skips the rest of the bad form and carries on.
+struct reader {
+    const char* next; // the part of the buffer not read yet
+    const char* end;
+    std::streambuf* stream; // where the input continues after the buffer, if anywhere
+    std::string token; // the atom being read, reused between atoms
+    size_t depth; // lists open around the current position
+    std::string error; // what the last readError was
+    size_t line, column; // of the next character, from 1
+    // whether to note where lambdas are in lambdaLocations, and the file
+    // they are in; without one they are located by line and column
+    bool locating;
+    std::string file;
+
+    reader(const char* begin, const char* end) : next(begin), end(end), stream(0), depth(0), line(1), column(1), locating(false) {}
+    explicit reader(std::istream& input) : next(0), end(0), stream(input.rdbuf()), depth(0), line(1), column(1), locating(false) {}
+
+    // the next character without consuming it, or EOF
+    int peek()
+	{
+	    if (next != end)
+		return static_cast<unsigned char>(*next);
+	    return stream ? stream->sgetc() : EOF;
+	}
+
+    int get()
+	{
+	    int c = next != end ? static_cast<unsigned char>(*next++) : stream ? stream->sbumpc() : EOF;
+	    if (c == '\n') {
+		++line;
+		column = 1;
+	    }
+	    else
+		++column;
+	    return c;
+	}
+
+    static bool delimiter(int c)
+	{
+	    return c == EOF || whitespace(char(c)) || c == '(' || c == ')' || c == ';';
+	}
+
+    // skip whitespace and ; comments, then return the next character
+    int skip()
+	{
+	    for (;;) {
+		int c = peek();
+		if (c == ';')
+		    while (c != EOF && c != '\n')
+			c = get();
+		else if (c != EOF && whitespace(char(c)))
+		    get();
+		else
+		    return c;
+	    }
+	}
+
+    // read the next top-level form into `form`
+    readResult read(cell& form)
+	{
+	    int c = skip();
+	    if (c == EOF)
+		return readEnd;
+	    if (c == ')') {
+		get();
+		fail("unexpected )");
+		return readError;
+	    }
+	    depth = 0;
+	    if (readItem(form))
+		return readForm;
+	    // skip to the ) that closes the outermost list still open
+	    while (depth > 0 && (c = skip()) != EOF) {
+		get();
+		if (c == '(')
+		    ++depth;
+		else if (c == ')')
+		    --depth;
+	    }
+	    return readError;
+	}
+
+    // read the item that starts at the next character (skip() has been
+    // called); a ) or the end of input there means the item is missing
+    bool readItem(cell& form)
+	{
+	    int c = peek();
+	    if (c == EOF)
+		return unexpectedEnd();
+	    if (c == ')') {
+		// consumed like any ), so recovery finds where the form ends
+		get();
+		if (depth > 0)
+		    --depth;
+		return fail("unexpected )");
+	    }
+	    get();
+	    if (c == '\'') {                 // 'exp is (quote exp)
+		cell quoted;
+		skip();
+		if (!readItem(quoted))
+		    return false;
+		form = cell(List, cell(Symbol, "quote"), cell(List, quoted, NIL));
+		return true;
+	    }
+	    if (c == '(') {
+		size_t atLine = line, atColumn = column - 1;
+		++depth;
+		if (!readList(form))
+		    return false;
+		pairObject* list = form.pair(); // 0 for ()
+		if (locating && list && list->car.type == Symbol && list->car.sym == lambdaKeyword)
+		    lambdaLocations[list] = file.empty()
+			? std::to_string(atLine) + ':' + std::to_string(atColumn)
+			: file + ':' + std::to_string(atLine);
+		return true;
+	    }
+	    if (!stream) {
+		// the atom is read in place, straight out of the buffer
+		const char* start = next - 1;
+		while (next != end && !delimiter(static_cast<unsigned char>(*next)))
+		    ++next;
+		column += next - start - 1;
+		form = atom(std::string_view(start, next - start));
+		return true;
+	    }
+	    token.assign(1, char(c));
+	    while (!delimiter(peek()))
+		token += char(get());
+	    form = atom(token);
+	    return true;
+	}
+
+    // the items up to the closing `)`, linked as they are read
+    bool readList(cell& form)
+	{
+	    form = NIL;
+	    pairObject* last = 0;
+	    for (;;) {
+		int c = skip();
+		if (c == EOF)
+		    return unexpectedEnd();
+		if (c == ')') {
+		    get();
+		    --depth;
+		    return true;
+		}
+		cell item;
+		if (!readItem(item))
+		    return false;
+		if (last && item.type == Symbol && item.name() == ".") { // (a . b)
+		    skip();
+		    if (!readItem(last->cdr))
+			return false;
+		    c = skip();
+		    if (c == EOF)
+			return unexpectedEnd();
+		    if (c != ')')
+			return fail("bad syntax: expected ) after the cdr of a dotted list");
+		    get();
+		    --depth;
+		    return true;
+		}
+		cell pair(List, item, NIL);
+		if (last)
+		    last->cdr = pair;
+		else
+		    form = pair;
+		last = pair.pair();
+	    }
+	}
+
+    bool fail(const char* message)
+	{
+	    error = message;
+	    return false;
+	}
+
+    bool unexpectedEnd() { return fail("unexpected end of input"); }
+};
+
+// return the Lisp expression represented by the given string
+cell read(const std::string& s)
+{
+    reader in(s.data(), s.data() + s.size());
+    cell form;
+    if (in.read(form) == readError)
+        std::cout << in.error << '\n';
+    return form;
+}
+
+// convert given cell to a Lisp-readable string
+std::string toString(const cell& exp)
+{
+    if (exp.type == List) {
+        std::string s("(");
+        // adds elements of the list as part of the output when evaluated
+        cell rest(exp);
+        for (; rest.pair(); rest = rest.pair()->cdr)
+            s += toString(rest.pair()->car) + ' ';
+        // a list not ended by () shows its last cdr after a dot
+        if (!rest.isNull())
+            s += ". " + toString(rest);
+        // truncate last list item if it's somehow a whitespace
+        if (s[s.size() - 1] == ' ')
+            s.erase(s.size() - 1);
+        // add closing bracket
+        return s + ')';
+    }
+    // shows that a lambda was defined
+    else if (exp.type == Lambda)
+        return "<Lambda>";
+    // shows a procedure was defined
+    else if (exp.type == Proc)
+        return "<Proc>";
+    else if (exp.type == Memo)
+        return "<Memo>";
+    else if (exp.type == Number)
+        return stringify(exp.number);
+    else if (exp.type == Bignum)
+        return integerToString(toInteger(exp));
+    else if (exp.type == Rational)
+        return toString(rational(exp)->numerator) + '/' + toString(rational(exp)->denominator);
+    else if (exp.type == Real)
+        return realToString(exp.real);
+    // #f64(1.0 2.5), which doesn't read back
+    else if (exp.type == F64Vector) {
+        std::string s("#f64(");
+        const std::vector<double>& elements = f64vector(exp)->elements;
+        for (size_t i = 0; i < elements.size(); ++i)
+            s += (i ? " " : "") + realToString(elements[i]);
+        return s + ')';
+    }
+    else if (exp.type == HashTable)
+        return "#<hash-table " + stringify(int64_t(hashTable(exp)->count)) + '>';
+    // if it's not a list, lambda, procedure or number, it must be a symbol
+    return exp.name();
+}
+
+
+///////////////////// user interaction
+
+// A whole file mapped read-only into memory, so that the reader can parse
+// it in place: the pages are read once, by the reader itself. `data` is 0
+// when the file can't be mapped (it doesn't exist, is empty, or is not a
+// regular file).
+struct mappedFile {
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+
+    explicit mappedFile(const std::string& name) : data(0), size(0)
+	{
+#ifdef _WIN32
+	    mapping = 0;
+	    file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	    LARGE_INTEGER length;
+	    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &length) || length.QuadPart == 0)
+		return;
+	    mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	    if (mapping && (data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))))
+		size = size_t(length.QuadPart);
+#else
+	    int fd = open(name.c_str(), O_RDONLY);
+	    struct stat info;
+	    if (fd < 0)
+		return;
+	    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		void* view = mmap(0, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED) {
+		    data = static_cast<const char*>(view);
+		    size = size_t(info.st_size);
+		}
+	    }
+	    close(fd); // the mapping stays valid on its own
+#endif
+	}
+
+    ~mappedFile()
+	{
+#ifdef _WIN32
+	    if (data)
+		UnmapViewOfFile(data);
+	    if (mapping)
+		CloseHandle(mapping);
+	    if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+#else
+	    if (data)
+		munmap(const_cast<char*>(data), size);
+#endif
+	}
+
+    private:
+    mappedFile(const mappedFile&);
+    mappedFile& operator=(const mappedFile&);
+};
+
+// evaluate every form the reader gives, reporting the syntax errors (whose
+// forms are skipped) along with where they come from
+void evalAll(reader& in, const std::string& name)
+{
+    in.locating = true;
+    in.file = name;
+    cell form;
+    for (readResult r; (r = in.read(form)) != readEnd;)
+	if (r == readForm)
+	    eval(form);
+	else
+	    std::cout << name << ": " << in.error << '\n';
+}
+
+// load a file, evaluating each form as soon as it has been read: straight
+// out of a mapping of the file where possible, otherwise from a stream
+void loadFile(const std::string& name) {
+	mappedFile mapped(name);
+	if (mapped.data) {
+	    reader in(mapped.data, mapped.data + mapped.size);
+	    evalAll(in, name);
+	    return;
+	}
+	std::ifstream input(name, std::ios::binary);
+	if (!input) {
+	    std::cout << "cannot open '" << name << "'\n";
+	    return;
+	}
+	reader in(input);
+	evalAll(in, name);
+}
+
+// the default read-eval-print-loop
+void repl(const std::string& prompt)
+{
+    reader in(std::cin);
+    in.locating = true;
+    cell form;
     for (;;) {
         // prints the current prompt after previous instruction is done
         std::cout << prompt;
-        // the `read` part of a read-eval-print-loop
-        std::string expr;
-        expr = fetch(std::cin);
+        // the `read` part of a read-eval-print-loop; stops at the end of the
+        // input, and a syntax error only costs the form it is in
+        readResult r = in.read(form);
+        if (r == readEnd)
+            break;
+        if (r == readError) {
+            std::cout << in.error << '\n';
+            continue;
+        }
         // `eval`, stringify and `print`
-        std::cout << toString(eval(read(expr), env)) << '\n';
+        std::cout << toString(eval(form)) << '\n';
+    }
+}
+
+
+
+////////////////////// images
+
+// An image is the global environment written out as a graph: every interned
+// symbol by name, then every object reachable from a global binding (pairs,
+// lambdas and their frames, f64vectors, hash tables, memoized procedures
+// without their caches), then the bindings. Primitives are saved by their
+// position in `primitives`, and lambdas by the form and scope names of the
+// lambda expression they came from, so loading an image rebuilds their code
+// for whichever engine is running instead of reading any file.
+//
+// Layout, all numbers little-endian:
+//   "CISPIMG1"
+//   u32 symbols,  each: u32 length, bytes of the name
+//   u32 objects,  each: u8 kind, u32 slots (frames and vectors) or entries
+//                 (hash tables)
+//   then each object's contents: pair: cell car, cell cdr
+//                                lambda: u32 source, u32 frame
+//                                frame: u32 outer frame, u32 lambda, cell*
+//                                vector: the 64 bits of each double
+//                                hash table: cell key, cell value*
+//                                memo: cell procedure, u64 bound
+//   u32 sources,  each: cell form, u32 scopes, each: u32 names, u32 symbol*
+//   u32 globals,  each: u32 symbol, cell value
+// A cell is a u8 type followed by a u32 symbol, primitive or object number,
+// by an i64 Number, by the 64 bits of a Real, by a Rational's numerator and
+// denominator cells, or by a Bignum's u8 sign, u32 length and u32 digits;
+// object numbers start at 1 so that 0 can mean none, and an unbound symbol
+// is 0xffffffff.
+
+const char imageMagic[] = "CISPIMG1";
+
+enum imageObjectKind { imagePair, imageLambda, imageFrame, imageVector, imageHashTable, imageMemo };
+
+struct imageWriter {
+    std::string out;
+    std::unordered_map<symbol*, uint32_t> symbolIds;
+    std::unordered_map<lambdaSource*, uint32_t> sourceIds;
+    std::vector<lambdaSource*> sources;
+    std::unordered_map<heapObject*, uint32_t> objectIds;
+    std::vector<std::pair<imageObjectKind, heapObject*> > objects;
+
+    void put8(uint8_t n) { out += char(n); }
+    void put32(uint32_t n)
+	{
+	    for (int i = 0; i < 4; ++i)
+		out += char(n >> (8 * i));
+	}
+    void put64(uint64_t n)
+	{
+	    for (int i = 0; i < 8; ++i)
+		out += char(n >> (8 * i));
+	}
+
+    static lambdaSource* sourceOf(lambdaObject* lambda)
+	{
+	    return lambda->code ? lambda->code->source.get() : lambda->compiled->source.get();
+	}
+
+    // number an object the first time it is seen; 0 for none
+    uint32_t object(imageObjectKind kind, heapObject* o)
+	{
+	    if (!o)
+		return 0;
+	    uint32_t& id = objectIds[o];
+	    if (!id) {
+		objects.push_back(std::make_pair(kind, o));
+		id = uint32_t(objects.size());
+	    }
+	    return id;
+	}
+
+    uint32_t source(lambdaSource* s)
+	{
+	    uint32_t& id = sourceIds[s];
+	    if (!id) {
+		sources.push_back(s);
+		id = uint32_t(sources.size());
+		// its form is saved with the other objects
+		reach(s->form.value);
+	    }
+	    return id - 1;
+	}
+
+    void reach(const cell& c)
+	{
+	    if (c.type == List)
+		object(imagePair, c.object);
+	    else if (c.type == Lambda)
+		object(imageLambda, c.object);
+	    else if (c.type == F64Vector)
+		object(imageVector, c.object);
+	    else if (c.type == HashTable)
+		object(imageHashTable, c.object);
+	    else if (c.type == Memo)
+		object(imageMemo, c.object);
+	}
+
+    // number everything reachable from the globals, breadth first so long
+    // lists don't recurse
+    void discover()
+	{
+	    symbolTable& table = symbols();
+	    for (symbolTable::iterator i = table.begin(); i != table.end(); ++i)
+		reach(i->second->value);
+	    for (size_t i = 0; i < objects.size(); ++i) {
+		heapObject* o = objects[i].second;
+		switch (objects[i].first) {
+		case imagePair:
+		    reach(static_cast<pairObject*>(o)->car);
+		    reach(static_cast<pairObject*>(o)->cdr);
+		    break;
+		case imageLambda: {
+		    lambdaObject* lambda = static_cast<lambdaObject*>(o);
+		    source(sourceOf(lambda));
+		    object(imageFrame, lambda->environment);
+		    break;
+		}
+		case imageFrame: {
+		    environment* frame = static_cast<environment*>(o);
+		    object(imageFrame, frame->outer);
+		    object(imageLambda, frame->lambda);
+		    for (size_t slot = 0; slot < frame->size; ++slot)
+			reach(frame->slots[slot]);
+		    break;
+		}
+		case imageVector:
+		    break;
+		case imageHashTable: {
+		    const std::vector<hashTableObject::entry>& entries = static_cast<hashTableObject*>(o)->entries;
+		    for (size_t e = 0; e < entries.size(); ++e)
+			if (entries[e].used) {
+			    reach(entries[e].key);
+			    reach(entries[e].value);
+			}
+		    break;
+		}
+		case imageMemo:
+		    reach(static_cast<memoObject*>(o)->function);
+		    break;
+		}
+	    }
+	}
+
+    bool putCell(const cell& c)
+	{
+	    put8(uint8_t(c.type));
+	    switch (c.type) {
+	    case Symbol:
+		put32(c.sym ? symbolIds[c.sym] : 0xffffffff);
+		break;
+	    case Number:
+		put64(uint64_t(c.number));
+		break;
+	    case Real: {
+		uint64_t bits;
+		memcpy(&bits, &c.real, sizeof(bits));
+		put64(bits);
+		break;
+	    }
+	    case Rational:
+		if (!putCell(rational(c)->numerator) || !putCell(rational(c)->denominator))
+		    return false;
+		break;
+	    case Bignum: {
+		const digits& magnitude = bignum(c)->magnitude;
+		put8(bignum(c)->negative);
+		put32(uint32_t(magnitude.size()));
+		for (size_t i = 0; i < magnitude.size(); ++i)
+		    put32(magnitude[i]);
+		break;
+	    }
+	    case List:
+	    case Lambda:
+	    case F64Vector:
+	    case HashTable:
+	    case Memo:
+		put32(objectIds[c.object]);
+		break;
+	    case Proc: {
+		size_t i = 0;
+		while (i < primitiveCount && primitives[i].proc != c.proc)
+		    ++i;
+		if (i == primitiveCount)
+		    return false;
+		put32(uint32_t(i));
+		break;
+	    }
+	    }
+	    return true;
+	}
+
+    bool write()
+	{
+	    out.append(imageMagic, 8);
+	    symbolTable& table = symbols();
+	    put32(uint32_t(table.size()));
+	    for (symbolTable::iterator i = table.begin(); i != table.end(); ++i) {
+		symbolIds[i->second] = uint32_t(symbolIds.size());
+		put32(uint32_t(i->second->name.size()));
+		out += i->second->name;
+	    }
+	    discover();
+	    put32(uint32_t(objects.size()));
+	    for (size_t i = 0; i < objects.size(); ++i) {
+		put8(uint8_t(objects[i].first));
+		if (objects[i].first == imageFrame)
+		    put32(uint32_t(static_cast<environment*>(objects[i].second)->size));
+		else if (objects[i].first == imageVector)
+		    put32(uint32_t(static_cast<f64vectorObject*>(objects[i].second)->elements.size()));
+		else if (objects[i].first == imageHashTable)
+		    put32(uint32_t(static_cast<hashTableObject*>(objects[i].second)->count));
+	    }
+	    bool ok = true;
+	    for (size_t i = 0; i < objects.size(); ++i) {
+		heapObject* o = objects[i].second;
+		switch (objects[i].first) {
+		case imagePair:
+		    ok = putCell(static_cast<pairObject*>(o)->car) && ok;
+		    ok = putCell(static_cast<pairObject*>(o)->cdr) && ok;
+		    break;
+		case imageLambda:
+		    put32(sourceIds[sourceOf(static_cast<lambdaObject*>(o))] - 1);
+		    put32(objectIds[static_cast<lambdaObject*>(o)->environment]);
+		    break;
+		case imageFrame: {
+		    environment* frame = static_cast<environment*>(o);
+		    put32(objectIds[frame->outer]);
+		    put32(objectIds[frame->lambda]);
+		    for (size_t slot = 0; slot < frame->size; ++slot)
+			ok = putCell(frame->slots[slot]) && ok;
+		    break;
+		}
+		case imageVector: {
+		    const std::vector<double>& elements = static_cast<f64vectorObject*>(o)->elements;
+		    for (size_t e = 0; e < elements.size(); ++e) {
+			uint64_t bits;
+			memcpy(&bits, &elements[e], sizeof(bits));
+			put64(bits);
+		    }
+		    break;
+		}
+		case imageHashTable: {
+		    const std::vector<hashTableObject::entry>& entries = static_cast<hashTableObject*>(o)->entries;
+		    for (size_t e = 0; e < entries.size(); ++e)
+			if (entries[e].used) {
+			    ok = putCell(entries[e].key) && ok;
+			    ok = putCell(entries[e].value) && ok;
+			}
+		    break;
+		}
+		case imageMemo:
+		    ok = putCell(static_cast<memoObject*>(o)->function) && ok;
+		    put64(static_cast<memoObject*>(o)->bound);
+		    break;
+		}
+	    }
+	    put32(uint32_t(sources.size()));
+	    for (size_t i = 0; i < sources.size(); ++i) {
+		ok = putCell(sources[i]->form.value) && ok;
+		put32(uint32_t(sources[i]->scopes.size()));
+		for (size_t d = 0; d < sources[i]->scopes.size(); ++d) {
+		    const std::vector<symbol*>& names = sources[i]->scopes[d];
+		    put32(uint32_t(names.size()));
+		    for (size_t n = 0; n < names.size(); ++n)
+			put32(symbolIds[names[n]]);
+		}
+	    }
+	    uint32_t globals = 0;
+	    for (symbolTable::iterator i = table.begin(); i != table.end(); ++i)
+		if (!isUnbound(i->second->value))
+		    ++globals;
+	    put32(globals);
+	    for (symbolTable::iterator i = table.begin(); i != table.end(); ++i)
+		if (!isUnbound(i->second->value)) {
+		    put32(symbolIds[i->second]);
+		    ok = putCell(i->second->value) && ok;
+		}
+	    return ok;
+	}
+};
+
+// write the global environment to `name`
+bool dumpImage(const std::string& name)
+{
+    imageWriter image;
+    if (!image.write()) {
+        std::cout << "cannot dump a procedure that isn't a built-in primitive\n";
+        return false;
+    }
+    std::ofstream output(name, std::ios::binary);
+    output.write(image.out.data(), std::streamsize(image.out.size()));
+    if (!output) {
+        std::cout << "cannot write '" << name << "'\n";
+        return false;
+    }
+    return true;
+}
+
+struct imageReader {
+    const char* next;
+    const char* end;
+    bool ok; // false once anything was out of bounds or out of range
+    std::vector<symbol*> symbols;
+    std::vector<std::shared_ptr<lambdaSource> > sources;
+    std::vector<heapObject*> objects; // numbered from 1, as in the file
+    std::vector<imageObjectKind> kinds;
+    std::vector<uint32_t> entryCounts; // of the hash tables, by object number
+
+    imageReader(const char* begin, const char* end) : next(begin), end(end), ok(true), objects(1), kinds(1) {}
+
+    bool has(size_t bytes)
+	{
+	    if (size_t(end - next) < bytes)
+		ok = false;
+	    return ok;
+	}
+    uint8_t get8() { return has(1) ? uint8_t(*next++) : 0; }
+    uint32_t get32()
+	{
+	    uint32_t n = 0;
+	    if (has(4))
+		for (int i = 0; i < 4; ++i)
+		    n |= uint32_t(uint8_t(*next++)) << (8 * i);
+	    return n;
+	}
+    uint64_t get64()
+	{
+	    uint64_t n = 0;
+	    if (has(8))
+		for (int i = 0; i < 8; ++i)
+		    n |= uint64_t(uint8_t(*next++)) << (8 * i);
+	    return n;
+	}
+
+    symbol* getSymbol()
+	{
+	    uint32_t id = get32();
+	    if (id < symbols.size())
+		return symbols[id];
+	    ok = false;
+	    return 0;
+	}
+
+    heapObject* getObject(imageObjectKind kind)
+	{
+	    uint32_t id = get32();
+	    if (id < objects.size() && (id == 0 || kinds[id] == kind))
+		return objects[id];
+	    ok = false;
+	    return 0;
+	}
+
+    cell getCell()
+	{
+	    cell c;
+	    switch (get8()) {
+	    case Symbol: {
+		uint32_t id = get32();
+		if (id != 0xffffffff)
+		    c.sym = id < symbols.size() ? symbols[id] : (ok = false, (symbol*)0);
+		break;
+	    }
+	    case Number:
+		c = cell(Number, int64_t(get64()));
+		break;
+	    case Bignum: {
+		integer n;
+		n.negative = get8() != 0;
+		uint32_t size = get32();
+		if (has(size_t(size) * 4))
+		    for (uint32_t i = 0; i < size; ++i)
+			n.magnitude.push_back(get32());
+		c = makeInteger(n);
+		break;
+	    }
+	    case Real: {
+		uint64_t bits = get64();
+		memcpy(&c.real, &bits, sizeof(bits));
+		c.type = Real;
+		break;
+	    }
+	    case Rational: {
+		cell n = getCell(), d = getCell();
+		if (isInteger(n) && isInteger(d) && !isZero(d))
+		    c = makeRational(n, d);
+		else
+		    ok = false;
+		break;
+	    }
+	    case List:
+		c.type = List;
+		c.object = getObject(imagePair);
+		break;
+	    case Lambda:
+		c.type = Lambda;
+		c.object = getObject(imageLambda);
+		ok = ok && c.object;
+		break;
+	    case F64Vector:
+		c.type = F64Vector;
+		c.object = getObject(imageVector);
+		ok = ok && c.object;
+		break;
+	    case HashTable:
+		c.type = HashTable;
+		c.object = getObject(imageHashTable);
+		ok = ok && c.object;
+		break;
+	    case Memo:
+		c.type = Memo;
+		c.object = getObject(imageMemo);
+		ok = ok && c.object;
+		break;
+	    case Proc: {
+		uint32_t i = get32();
+		if (i < primitiveCount)
+		    c = cell(primitives[i].proc);
+		else
+		    ok = false;
+		break;
+	    }
+	    default:
+		ok = false;
+	    }
+	    return c;
+	}
+
+    // analyze (or compile) a lambda's form again in scopes with its names
+    void rebuild(lambdaObject* lambda, const std::shared_ptr<lambdaSource>& source)
+	{
+	    std::deque<scope> chain;
+	    const scope* sc = 0;
+	    for (size_t d = source->scopes.size(); d-- > 0;) {
+		chain.push_back(scope(sc));
+		chain.back().names = source->scopes[d];
+		sc = &chain.back();
+	    }
+	    if (useVirtualMachine) {
+		prototype holder;
+		compiler c(&holder);
+		c.compile(source->form.value, sc, false);
+		lambda->compiled = holder.children.at(0);
+	    }
+	    else
+		lambda->code = std::static_pointer_cast<lambdaNode>(analyze(source->form.value, sc));
+	}
+
+    bool read()
+	{
+	    if (!has(8) || std::string(next, 8) != imageMagic)
+		return false;
+	    next += 8;
+	    for (uint32_t i = 0, n = get32(); ok && i < n; ++i) {
+		uint32_t length = get32();
+		if (has(length))
+		    symbols.push_back(intern(std::string_view(next, length)));
+		next += ok ? length : 0;
+	    }
+	    // make every object first so that references between them resolve
+	    for (uint32_t i = 0, n = get32(); ok && i < n; ++i) {
+		uint8_t byte = get8();
+		if (byte > imageMemo) {
+		    ok = false;
+		    break;
+		}
+		imageObjectKind kind = imageObjectKind(byte);
+		kinds.push_back(kind);
+		if (kind == imagePair)
+		    objects.push_back(track(new pairObject(NIL, NIL)));
+		else if (kind == imageLambda)
+		    objects.push_back(track(new lambdaObject(std::shared_ptr<lambdaNode>(), 0)));
+		else if (kind == imageFrame) {
+		    // no lambda until the second pass sets it, should that never run
+		    lambdaObject placeholder(std::shared_ptr<lambdaNode>(), 0);
+		    uint32_t size = get32();
+		    if (size <= SIZE_MAX / 5 && has(size_t(size) * 5)) {
+			environment* frame = environment::make(size, &placeholder, false);
+			frame->lambda = 0;
+			objects.push_back(frame);
+		    }
+		}
+		else if (kind == imageVector) {
+		    uint32_t size = get32();
+		    if (size <= SIZE_MAX / 8 && has(size_t(size) * 8))
+			objects.push_back(track(new f64vectorObject(size, 0), sizeof(f64vectorObject) + size_t(size) * sizeof(double)));
+		}
+		else if (kind == imageHashTable) {
+		    cell table = makeHashTable();
+		    objects.push_back(table.object);
+		    entryCounts.resize(objects.size());
+		    entryCounts.back() = get32();
+		}
+		else if (kind == imageMemo)
+		    objects.push_back(makeMemo(NIL, defaultMemoBound).object);
+		else
+		    ok = false;
+	    }
+	    std::vector<uint32_t> lambdaSources(objects.size());
+	    for (size_t i = 1; ok && i < objects.size(); ++i)
+		switch (kinds[i]) {
+		case imagePair: {
+		    pairObject* pair = static_cast<pairObject*>(objects[i]);
+		    pair->car = getCell();
+		    pair->cdr = getCell();
+		    break;
+		}
+		case imageLambda: {
+		    lambdaObject* lambda = static_cast<lambdaObject*>(objects[i]);
+		    lambdaSources[i] = get32();
+		    lambda->environment = static_cast<environment*>(getObject(imageFrame));
+		    break;
+		}
+		case imageFrame: {
+		    environment* frame = static_cast<environment*>(objects[i]);
+		    frame->outer = static_cast<environment*>(getObject(imageFrame));
+		    frame->lambda = static_cast<lambdaObject*>(getObject(imageLambda));
+		    for (size_t slot = 0; slot < frame->size; ++slot)
+			frame->slots[slot] = getCell();
+		    break;
+		}
+		case imageVector: {
+		    std::vector<double>& elements = static_cast<f64vectorObject*>(objects[i])->elements;
+		    for (size_t e = 0; e < elements.size(); ++e) {
+			uint64_t bits = get64();
+			memcpy(&elements[e], &bits, sizeof(bits));
+		    }
+		    break;
+		}
+		case imageHashTable: {
+		    hashTableObject* table = static_cast<hashTableObject*>(objects[i]);
+		    for (uint32_t e = 0; ok && e < entryCounts[i]; ++e) {
+			cell key = getCell();
+			table->set(key, getCell());
+		    }
+		    break;
+		}
+		case imageMemo: {
+		    memoObject* cache = static_cast<memoObject*>(objects[i]);
+		    cache->function = getCell();
+		    cache->bound = size_t(std::max<uint64_t>(1, get64()));
+		    break;
+		}
+		}
+	    for (uint32_t i = 0, n = get32(); ok && i < n; ++i) {
+		cell form = getCell();
+		// rebuilding anything but a lambda expression makes no lambda
+		pairObject* head = form.pair();
+		if (!head || head->car.type != Symbol || head->car.sym != lambdaKeyword)
+		    ok = false;
+		std::shared_ptr<lambdaSource> source(new lambdaSource(form, 0));
+		for (uint32_t d = 0, depth = get32(); ok && d < depth; ++d) {
+		    source->scopes.push_back(std::vector<symbol*>());
+		    for (uint32_t n = 0, names = get32(); ok && n < names; ++n)
+			source->scopes.back().push_back(getSymbol());
+		}
+		sources.push_back(source);
+	    }
+	    for (size_t i = 1; i < objects.size(); ++i)
+		if (kinds[i] == imageLambda && lambdaSources[i] >= sources.size())
+		    ok = false;
+	    std::vector<std::pair<symbol*, cell> > globals;
+	    for (uint32_t i = 0, n = get32(); ok && i < n; ++i) {
+		symbol* name = getSymbol();
+		globals.push_back(std::make_pair(name, getCell()));
+	    }
+	    if (!ok || next != end)
+		return false;
+	    // lambdas made by one lambda expression share its rebuilt code
+	    std::vector<lambdaObject*> built(sources.size());
+	    for (size_t i = 1; i < objects.size(); ++i)
+		if (kinds[i] == imageLambda) {
+		    lambdaObject* lambda = static_cast<lambdaObject*>(objects[i]);
+		    lambdaObject*& first = built[lambdaSources[i]];
+		    if (first) {
+			lambda->code = first->code;
+			lambda->compiled = first->compiled;
+		    }
+		    else {
+			rebuild(lambda, sources[lambdaSources[i]]);
+			first = lambda;
+		    }
+		}
+	    for (size_t i = 0; i < globals.size(); ++i)
+		globals[i].first->value = globals[i].second;
+	    return true;
+	}
+};
+
+// replace the global environment's bindings with those saved in `name`
+bool loadImage(const std::string& name)
+{
+    mappedFile mapped(name);
+    if (!mapped.data) {
+        std::cout << "cannot open '" << name << "'\n";
+        return false;
+    }
+    imageReader image(mapped.data, mapped.data + mapped.size);
+    if (!image.read()) {
+        std::cout << "'" << name << "' is not a valid image\n";
+        return false;
+    }
+    return true;
+}
+
+
+////////////////////// memory report
+
+// build `count` values with `make` and print what each one costs: the cell
+// itself plus whatever it allocated on the heap
+void reportValue(const char* kind, cell (*make)(), int count)
+{
+    cells values;
+    values.reserve(count);
+    size_t bytes = allocatedBytes, blocks = allocationCount;
+    for (int i = 0; i < count; ++i)
+        values.push_back(make());
+    bytes = allocatedBytes - bytes;
+    blocks = allocationCount - blocks;
+    std::cout << std::left << std::setw(10) << kind << std::right
+              << std::fixed << std::setprecision(1) << std::setw(8) << sizeof(cell) + double(bytes) / count << " bytes"
+              << std::setw(8) << double(blocks) / count << " allocations\n";
+}
+
+cell makeNumber() { return cell(Number, int64_t(42)); }
+cell makeTrue() { return trueSymbol; }
+cell makeSymbol() { return atom("counter"); } // interned after the first one
+cell makeList()
+{
+    // pair by pair: a scratch vector of the items would be counted too
+    cell list(List, cell(Number, int64_t(3)), NIL);
+    list = cell(List, cell(Number, int64_t(2)), list);
+    return cell(List, cell(Number, int64_t(1)), list);
+}
+cell makeLambda()
+{
+    static const std::shared_ptr<lambdaNode> code =
+        std::static_pointer_cast<lambdaNode>(analyze(read("(lambda (x) x)"), 0));
+    return cell(Lambda, code, 0);
+}
+
+// memory needed per value of each kind, used to keep an eye on the size of cell
+void memoryReport()
+{
+    const int count = 100000;
+    std::cout << "sizeof(cell) = " << sizeof(cell) << " bytes\n";
+    reportValue("number", &makeNumber, count);
+    reportValue("True", &makeTrue, count);
+    reportValue("symbol", &makeSymbol, count);
+    reportValue("(1 2 3)", &makeList, count);
+    reportValue("lambda", &makeLambda, count);
+}
+
+////////////////////// profile report
+
+profiler mainProfiler; // the main thread's, when --profile is given
+std::string foldedStacksFile = "profile.folded";
+
+// what the reports call a procedure: its name, or (lambda (params)) when
+// it was never defined as a variable
+std::string primitiveName(cell::procType proc)
+{
+    const primitive* p = findPrimitive(proc);
+    return p ? p->name : "<Proc>";
+}
+
+std::string lambdaName(const lambdaSource& source)
+{
+    if (!source.name.empty())
+        return source.name;
+    pairObject* lambda = source.form.value.pair();
+    pairObject* rest = lambda ? lambda->cdr.pair() : 0;
+    std::string name = "(lambda " + toString(rest ? rest->car : NIL) + ")";
+    return source.location.empty() ? name : name + ' ' + source.location;
+}
+
+std::string procedureName(const profiler::procedure& p)
+{
+    return p.source ? lambdaName(*p.source) : primitiveName(p.proc);
+}
+
+// one line per distinct stack, "outer;inner microseconds", as flamegraph
+// tools take it. The tree is as deep as the deepest recursion, so it is
+// walked with a stack of its own, the stacks are built in one shared path,
+// and only their innermost foldedDepth procedures are written (stacks that
+// end the same add up), which keeps the file in proportion to the tree.
+const size_t foldedDepth = 128;
+
+void writeFoldedStacks(std::ostream& out, const std::vector<std::string>& names)
+{
+    const std::vector<profiler::stackNode>& tree = mainProfiler.tree;
+    // a node still to write, with the length and procedures of its parent's path
+    struct pendingNode {
+        size_t node, length, depth;
+    };
+    std::vector<pendingNode> pending(1, pendingNode{ 0, 0, 0 });
+    std::string path;
+    std::vector<size_t> starts; // where each procedure on the path begins
+    std::map<std::string, int64_t> stacks;
+    while (!pending.empty()) {
+        pendingNode p = pending.back();
+        pending.pop_back();
+        path.resize(p.length);
+        starts.resize(p.depth);
+        const profiler::stackNode& n = tree[p.node];
+        if (p.node) {
+            if (!path.empty())
+                path += ';';
+            starts.push_back(path.size());
+            path += names[n.procedure];
+            if (n.exclusive)
+                stacks[path.substr(starts[starts.size() - std::min(starts.size(), foldedDepth)])] += n.exclusive;
+        }
+        for (size_t i = n.children.size(); i-- > 0;)
+            pending.push_back(pendingNode{ n.children[i], path.size(), starts.size() });
+    }
+    for (std::map<std::string, int64_t>::iterator i = stacks.begin(); i != stacks.end(); ++i)
+        if (i->second >= 500)
+            out << i->first << ' ' << (i->second + 500) / 1000 << '\n';
+}
+
+// print the procedures by exclusive time and write the folded stacks, at exit
+void profileReport()
+{
+    profiler& p = mainProfiler;
+    while (!p.stack.empty())
+        p.leave();
+    std::vector<std::string> names;
+    std::vector<size_t> order;
+    for (size_t i = 0; i < p.procedures.size(); ++i) {
+        names.push_back(procedureName(p.procedures[i]));
+        order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&p](size_t a, size_t b) {
+        return p.procedures[a].exclusive > p.procedures[b].exclusive;
+    });
+    std::cout << "\n" << std::left << std::setw(24) << "procedure" << std::right
+              << std::setw(12) << "calls" << std::setw(12) << "incl ms"
+              << std::setw(12) << "excl ms" << std::setw(12) << "allocs" << '\n';
+    for (size_t i = 0; i < order.size(); ++i) {
+        const profiler::procedure& proc = p.procedures[order[i]];
+        std::cout << std::left << std::setw(24) << names[order[i]] << std::right
+                  << std::setw(12) << proc.calls
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(12) << proc.inclusive / 1e6 << std::setw(12) << proc.exclusive / 1e6
+                  << std::setw(12) << proc.allocations << '\n';
+    }
+    std::ofstream folded(foldedStacksFile.c_str());
+    writeFoldedStacks(folded, names);
+    if (folded)
+        std::cout << "folded stacks written to " << foldedStacksFile << '\n';
+    else
+        std::cout << "cannot write " << foldedStacksFile << '\n';
+}
+
+
+////////////////////// sampling profiler
+
+// --sample keeps the engines out of it: a timer only counts a tick in
+// sampleTicks, and the main thread takes the sample when it next polls (see
+// samplePoll), crediting it with every tick since the last one. The frames
+// are all consistent there, so the running lambdas are read off them: the
+// frame each run() loop of the tree-walker is in (a loop that hasn't called
+// a lambda is still in its caller's frame) and the activations of the
+// virtual machine, whichever engine is in use. Time in a primitive counts
+// for the lambda calling it, as the poll comes when the primitive returns.
+struct samplingProfiler {
+    static constexpr size_t sampleDepth = 128; // innermost lambdas kept per sample
+
+    std::vector<const lambdaSource*> stack; // the sample being taken, innermost first
+    std::map<std::vector<const lambdaSource*>, size_t> counts; // by stack, outermost first
+    // the lambdas counted, kept alive so that no other one gets their address
+    std::unordered_map<const lambdaSource*, std::shared_ptr<lambdaSource> > sources;
+    size_t samples;
+
+    samplingProfiler() : samples(0) {}
+
+    void add(const std::shared_ptr<lambdaSource>& source)
+	{
+	    stack.push_back(source.get());
+	    if (!sources.count(source.get()))
+		sources[source.get()] = source;
+	}
+
+    // count `ticks` samples of the stack as it is now
+    void sample(unsigned ticks)
+	{
+	    stack.clear();
+	    for (size_t i = machine.calls.size(); i-- > 0 && stack.size() < sampleDepth;)
+		if (const std::shared_ptr<lambdaSource>& source = machine.calls[i].proto->source)
+		    add(source);
+	    environment* inner = 0;
+	    for (size_t i = roots.frameRoots.size(); i-- > 0 && stack.size() < sampleDepth;) {
+		environment* frame = *roots.frameRoots[i];
+		if (frame && frame != inner && frame->lambda->code)
+		    add(frame->lambda->code->source);
+		inner = frame;
+	    }
+	    counts[std::vector<const lambdaSource*>(stack.rbegin(), stack.rend())] += ticks;
+	    samples += ticks;
+	}
+};
+
+samplingProfiler* sampler = 0; // when --sample is given
+std::string samplesFile;
+
+void takeSample()
+{
+    // worker threads leave it to the main thread
+    if (nursery)
+        return;
+    unsigned ticks = sampleTicks.exchange(0, std::memory_order_relaxed);
+    if (sampler)
+        sampler->sample(ticks);
+}
+
+#ifndef _WIN32
+void requestSample(int) { sampleTicks.fetch_add(1, std::memory_order_relaxed); }
+
+// SIGPROF every 1/rate seconds of the process's CPU time
+bool startSampling(int rate)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    itimerval timer;
+    int period = std::max(1, 1000000 / rate); // in microseconds
+    timer.it_interval.tv_sec = period / 1000000;
+    timer.it_interval.tv_usec = period % 1000000;
+    timer.it_value = timer.it_interval;
+    return sigaction(SIGPROF, &action, 0) == 0 && setitimer(ITIMER_PROF, &timer, 0) == 0;
+}
+
+void stopSampling()
+{
+    itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, 0);
+}
+#else
+std::atomic<bool> samplingStopped(false);
+std::thread samplingThread;
+
+// a thread that wakes up every 1/rate seconds of wall time to count a tick
+bool startSampling(int rate)
+{
+    samplingThread = std::thread([rate]() {
+        while (!samplingStopped.load()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(std::max(1, 1000000 / rate)));
+            sampleTicks.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    return true;
+}
+
+void stopSampling()
+{
+    samplingStopped = true;
+    if (samplingThread.joinable())
+        samplingThread.join();
+}
+#endif
+
+// write one line per distinct stack, "outer;inner samples", at exit
+void sampleReport()
+{
+    stopSampling();
+    std::map<std::string, size_t> stacks;
+    typedef std::map<std::vector<const lambdaSource*>, size_t>::const_iterator countIterator;
+    for (countIterator i = sampler->counts.begin(); i != sampler->counts.end(); ++i) {
+        std::string stack;
+        for (size_t f = 0; f < i->first.size(); ++f)
+            stack += (f ? ";" : "") + lambdaName(*i->first[f]);
+        stacks[stack.empty() ? "<top level>" : stack] += i->second;
+    }
+    std::ofstream out(samplesFile.c_str());
+    for (std::map<std::string, size_t>::iterator i = stacks.begin(); i != stacks.end(); ++i)
+        out << i->first << ' ' << i->second << '\n';
+    if (!out) {
+        std::cout << "cannot write " << samplesFile << '\n';
+        return;
+    }
+    std::cout << sampler->samples << " samples written to " << samplesFile << '\n';
+}
+
+
+////////////////////// benchmarks
+
+// load each program `runs` times and print the fastest and mean wall time,
+// heap allocations and procedure applications per run, and the allocations
+// per application, which is what copying in the evaluator shows up as
+int benchmark(const std::vector<std::string>& programs, int runs)
+{
+    if (programs.empty()) {
+        std::cout << "usage: cisp [--vm] --bench [--runs n] program.lisp...\n";
+        return 1;
+    }
+    std::cout << std::left << std::setw(24) << "program" << std::right
+              << std::setw(10) << "best ms" << std::setw(10) << "mean ms"
+              << std::setw(12) << "allocs" << std::setw(12) << "evals"
+              << std::setw(14) << "evals/s" << std::setw(13) << "allocs/eval" << '\n';
+    for (size_t p = 0; p < programs.size(); ++p) {
+        if (!std::ifstream(programs[p])) {
+            std::cout << programs[p] << ": cannot open\n";
+            return 1;
+        }
+        double best = 0, total = 0;
+        size_t allocations = allocationCount;
+        uint64_t evals = applicationCount;
+        for (int run = 0; run < runs; ++run) {
+            collect(); // start every run from the same heap
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            loadFile(programs[p]);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = run == 0 ? seconds : std::min(best, seconds);
+            total += seconds;
+        }
+        // allocations include the collections' own, which are few
+        double perRun = double(allocationCount - allocations) / runs;
+        double evalsPerRun = double(applicationCount - evals) / runs;
+        std::cout << std::left << std::setw(24) << programs[p] << std::right
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(10) << best * 1000 << std::setw(10) << total / runs * 1000
+                  << std::setprecision(0)
+                  << std::setw(12) << perRun << std::setw(12) << evalsPerRun
+                  << std::setw(14) << evalsPerRun * runs / total
+                  << std::setprecision(3) << std::setw(13) << (evalsPerRun ? perRun / evalsPerRun : 0) << '\n';
     }
+    return 0;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    environment globalEnvironment;
-    addGlobals(globalEnvironment);
-    repl("cisp > ", &globalEnvironment);
+    globalEnvironment globals;
+    addGlobals(globals);
+    bool bench = false, profile = false;
+    int runs = 10, sampleRate = 1000;
+    std::string image, dumpTo;
+    std::vector<std::string> programs;
+    for (int i = 1; i < argc; ++i) {
+        std::string option(argv[i]);
+        if (option == "--memory-report") {
+            memoryReport();
+            return 0;
+        }
+        else if (option == "--vm")
+            useVirtualMachine = true;
+        else if (option == "--bench")
+            bench = true;
+        else if (option == "--runs" && i + 1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (option == "--image" && i + 1 < argc)
+            image = argv[++i];
+        else if (option == "--dump-image" && i + 1 < argc)
+            dumpTo = argv[++i];
+        else if (option == "--profile")
+            profile = true;
+        else if (option == "--folded" && i + 1 < argc)
+            foldedStacksFile = argv[++i];
+        else if (option == "--sample" && i + 1 < argc)
+            samplesFile = argv[++i];
+        else if (option == "--sample-rate" && i + 1 < argc)
+            sampleRate = std::min(100000, std::max(1, atoi(argv[++i])));
+        else if ((bench || profile || !samplesFile.empty() || !dumpTo.empty()) && option[0] != '-')
+            programs.push_back(option);
+        else {
+            std::cout << "unknown option '" << option << "'\n";
+            return 1;
+        }
+    }
+    if (!image.empty() && !loadImage(image))
+        return 1;
+    if (profile && !samplesFile.empty()) {
+        std::cout << "--profile and --sample don't go together\n";
+        return 1;
+    }
+    // both are reported however the program ends, (exit) included
+    if (profile) {
+        activeProfiler = &mainProfiler;
+        std::atexit(profileReport);
+    }
+    if (!samplesFile.empty()) {
+        sampler = new samplingProfiler;
+        if (!startSampling(sampleRate)) {
+            std::cout << "cannot start the sampling timer\n";
+            return 1;
+        }
+        std::atexit(sampleReport);
+    }
+    if (bench)
+        return benchmark(programs, runs);
+    if (!dumpTo.empty()) {
+        // load the given files on top of the image, if any, and save the result
+        for (size_t i = 0; i < programs.size(); ++i)
+            loadFile(programs[i]);
+        return dumpImage(dumpTo) ? 0 : 1;
+    }
+    if ((profile || sampler) && !programs.empty()) {
+        for (size_t i = 0; i < programs.size(); ++i)
+            loadFile(programs[i]);
+        return 0;
+    }
+    repl("cisp > ");
 }
 
 // Run program: Ctrl + F5 or Debug > Start Without Debugging menu